@@ -0,0 +1,167 @@
+#include "feed.hpp"
+#include "kirin.hpp"
+#include "level_book.hpp"
+#include "price.hpp"
+#include "set_book.hpp"
+#include "signal.hpp"
+#include <cassert>
+#include <iostream>
+#include <iomanip>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+/*
+Replays one synthetic feed through SetBook (the old std::set MyBook) and LevelBook
+and reports the per-update latency of each, after checking that both agree on
+the touch, side volumes, level counts, depth, weighted depth and signal at every
+step. Every update is followed by the reads
+MyBot::on_order_update does (quote sizes, mid, spread, bbo and get_signal(30)), so
+the numbers are what the callback pays per order update. The "+engine" row swaps
+get_signal(30) for three SignalEngine imbalance variants kept up to date by the
+book.
+
+usage: ./bench_book [num_updates] [seed]
+*/
+
+
+// LevelBook with a SignalEngine attached; its get_signal reads three incremental
+// imbalance variants instead of walking orders
+struct EngineBook : public LevelBook {
+  SignalEngine engine;
+
+  EngineBook() {
+    set_listener(&engine);
+    engine.add(ImbalanceConfig{30, ImbalanceConfig::FLAT, 0.0, 10000});
+    engine.add(ImbalanceConfig{10, ImbalanceConfig::LINEAR, 0.0, NO_QTY_LIMIT});
+    engine.add(ImbalanceConfig{30, ImbalanceConfig::EXPONENTIAL, 0.15, 10000});
+  }
+
+  double get_signal(int) const {
+    return engine.imbalance(0) + engine.imbalance(1) + engine.imbalance(2);
+  }
+};
+
+// SetBook still reports doubles, LevelBook reports px_t
+static price_t as_price(price_t price) { return price; }
+static price_t as_price(px_t price) { return price.to_price(); }
+
+// what on_order_update reads from the book before deciding to requote
+template <typename Book>
+double read_path(Book& book) {
+  double x = 0.0;
+  x += book.quote_size(true) + book.quote_size(false);
+  x += book.get_mid_price(100.0) + as_price(book.spread());
+  x += as_price(book.get_bbo(true)) + as_price(book.get_bbo(false));
+  x += book.get_signal(30);
+  return x;
+}
+
+
+template <typename Book>
+std::vector<int64_t> replay(const std::vector<FeedEvent>& feed, double& sink) {
+  using namespace std::chrono;
+
+  Book book;
+  std::vector<int64_t> latencies;
+  latencies.reserve(feed.size());
+
+  for (const FeedEvent& e : feed) {
+    auto t0 = steady_clock::now();
+    apply(book, e);
+    sink += read_path(book);
+    auto t1 = steady_clock::now();
+    latencies.push_back(duration_cast<nanoseconds>(t1 - t0).count());
+  }
+
+  return latencies;
+}
+
+
+void report(const std::string& name, std::vector<int64_t> latencies) {
+  std::sort(latencies.begin(), latencies.end());
+
+  double total = 0.0;
+  for (int64_t x : latencies) {
+    total += x;
+  }
+
+  auto pct = [&](double p) {
+    return latencies[std::min(latencies.size() - 1, (size_t)(p * latencies.size()))];
+  };
+
+  std::cout << std::setw(10) << std::left << name
+            << " mean " << std::setw(8) << (int64_t)(total / latencies.size())
+            << " p50 " << std::setw(8) << pct(0.50)
+            << " p90 " << std::setw(8) << pct(0.90)
+            << " p99 " << std::setw(8) << pct(0.99)
+            << " p99.9 " << std::setw(8) << pct(0.999)
+            << " max " << latencies.back()
+            << "  (ns/update)" << std::endl;
+}
+
+
+// both books must agree on everything the strategy reads
+bool check(const std::vector<FeedEvent>& feed) {
+  SetBook ref;
+  EngineBook book;
+
+  for (size_t i = 0; i < feed.size(); i++) {
+    apply(ref, feed[i]);
+    apply(book, feed[i]);
+
+    // SetBook scans whole sides for these, so only compare them now and then
+    bool full = i % 64 == 0;
+
+    for (bool buy : {true, false}) {
+      if (as_price(ref.get_bbo(buy)) != as_price(book.get_bbo(buy)) ||
+          ref.quote_size(buy) != book.quote_size(buy) ||
+          (full && (ref.get_quote_vol(buy) != book.get_quote_vol(buy) ||
+                    ref.num_levels(buy) != book.num_levels(buy) ||
+                    ref.depth(buy, 10) != book.depth(buy) ||
+                    ref.weighted_depth(buy, 10) != book.weighted_depth(buy)))) {
+        std::cout << "mismatch at update " << i << " side " << buy << std::endl;
+        return false;
+      }
+    }
+    if (full) {
+      SignalEngine fresh = book.engine;
+      fresh.refresh(book);
+      for (size_t v = 0; v < fresh.size(); v++) {
+        if (std::abs(fresh.imbalance(v) - book.engine.imbalance(v)) > 1e-9) {
+          std::cout << "imbalance " << v << " drifted at update " << i << std::endl;
+          return false;
+        }
+      }
+    }
+
+    double a = ref.get_signal(30), b = book.LevelBook::get_signal(30);
+    if (!(a == b || (a != a && b != b))) {
+      std::cout << "signal mismatch at update " << i << ": " << a << " vs " << b << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+
+int main(int argc, const char ** argv) {
+  size_t n = argc > 1 ? std::stoull(argv[1]) : 1000000;
+  uint64_t seed = argc > 2 ? std::stoull(argv[2]) : 42;
+
+  std::vector<FeedEvent> feed = make_feed(n, seed);
+  std::cout << "feed: " << feed.size() << " updates, seed " << seed << std::endl;
+
+  if (!check(feed)) {
+    return 1;
+  }
+
+  double sink = 0.0;
+  report("SetBook", replay<SetBook>(feed, sink));
+  report("LevelBook", replay<LevelBook>(feed, sink));
+  report("+engine", replay<EngineBook>(feed, sink));
+
+  return sink == 0.12345; // keep the reads alive
+}
@@ -0,0 +1,471 @@
+#define COMPETITOR_NO_MAIN
+#include "competitor.cpp"
+#include "capture.hpp"
+#include "feed.hpp"
+#include "perf_counters.hpp"
+#include "set_book.hpp"
+
+#include <memory>
+#include <random>
+#include <unordered_map>
+
+/*
+Microbenchmarks for the pieces of the bot, each reported as ns/op and, where
+perf_event_open works, cache misses and instructions per op:
+
+  book insert / decrease_qty / cancel   one order each, on a book built from
+                                        the feed's inserts
+  book feed                             the synthetic feed applied in order
+  book bbo / mid / get_signal(30)       queries on the book the feed left
+  OrderIdMap / unordered_map            insert, find and erase of 100k random
+    insert / find / erase               64-bit order ids, as the Communicator
+                                        hands them out, after checking that
+                                        the two maps agree
+  state feed / get_pnl / imbalance      the same through MyState, signal
+                                        engines included
+  bot packet                            MyBot's whole per-packet path, one
+                                        feed update per packet, requotes
+                                        included (gateway in SIM mode; each
+                                        packet also carries the replies to
+                                        the bot's own orders, see sim_replies)
+  bot 8/packet [conflated]              eight updates to a packet without the
+                                        time throttle, requoting per ORDER
+                                        update or (conflated) per packet
+  bot capture                           the same over a recorded session
+
+The book rows run for SetBook (the old MyBook) and LevelBook side by side, which
+is the comparison competitor_slow.cpp and competitor.cpp used to be for.
+
+Before any of it, OrderIdMap, OwnOrders::expire_pending and the Wire
+encode/decode round trip are checked against what they should do, and the run
+fails if they disagree.
+
+usage: ./bench_bot [num_updates] [seed] [capture.bin]
+*/
+
+
+static double sink = 0.0; // keeps query results alive
+
+// SetBook still reports doubles, LevelBook reports px_t
+static price_t as_price(price_t price) { return price; }
+static price_t as_price(px_t price) { return price.to_price(); }
+
+static PerfCounters& counters() {
+  static PerfCounters pc;
+  return pc;
+}
+
+template <typename F>
+void run_case(const std::string& name, size_t ops, F body) {
+  PerfCounters& pc = counters();
+
+  pc.start();
+  const int64_t t0 = now_ns();
+  body();
+  const int64_t t1 = now_ns();
+  const PerfCounters::Reading r = pc.stop();
+
+  std::cout << std::setw(28) << std::left << name
+            << std::setw(10) << std::right << std::fixed << std::setprecision(1)
+            << (double)(t1 - t0) / ops << " ns/op";
+  if (pc.available()) {
+    std::cout << std::setw(10) << (double)r.cache_misses / ops << " misses/op"
+              << std::setw(10) << (double)r.instructions / ops << " instr/op";
+  }
+  std::cout << std::endl;
+}
+
+
+template <typename Book>
+void book_cases(const std::string& label, const std::vector<FeedEvent>& feed,
+                const std::vector<FeedEvent>& inserts, size_t queries) {
+  {
+    Book book;
+    run_case(label + " insert", inserts.size(), [&] {
+      for (const FeedEvent& e : inserts) {
+        apply(book, e);
+      }
+    });
+    run_case(label + " decrease_qty", inserts.size(), [&] {
+      for (const FeedEvent& e : inserts) {
+        book.decrease_qty(e.order_id, 1);
+      }
+    });
+    run_case(label + " cancel", inserts.size(), [&] {
+      for (const FeedEvent& e : inserts) {
+        book.cancel(0, e.order_id);
+      }
+    });
+  }
+
+  Book book;
+  run_case(label + " feed", feed.size(), [&] {
+    for (const FeedEvent& e : feed) {
+      apply(book, e);
+    }
+  });
+  run_case(label + " bbo", queries, [&] {
+    for (size_t i = 0; i < queries; i++) {
+      sink += as_price(book.get_bbo(i & 1));
+    }
+  });
+  run_case(label + " mid", queries, [&] {
+    for (size_t i = 0; i < queries; i++) {
+      sink += book.get_mid_price(100.0);
+    }
+  });
+  run_case(label + " get_signal(30)", queries, [&] {
+    for (size_t i = 0; i < queries; i++) {
+      sink += book.get_signal(30);
+    }
+  });
+}
+
+
+// random ops on a small id pool (0 included) must leave OrderIdMap and
+// std::unordered_map agreeing on every lookup and on the final contents
+static bool check_id_map(uint64_t seed) {
+  std::mt19937_64 rng(seed);
+  std::vector<order_id_t> pool(4096);
+  for (order_id_t& id : pool) {
+    id = rng();
+  }
+  pool[0] = 0;
+
+  OrderIdMap<uint64_t> map(16); // small, so it has to grow
+  std::unordered_map<order_id_t, uint64_t> ref;
+  for (size_t i = 0; i < 1000000; i++) {
+    order_id_t id = pool[rng() % pool.size()];
+    uint64_t op = rng() % 3;
+    bool ok;
+    if (op == 0) {
+      ok = map.emplace(id, i) == ref.emplace(id, i).second;
+    } else if (op == 1) {
+      ok = map.erase(id) == (ref.erase(id) == 1);
+    } else {
+      const uint64_t* v = map.find(id);
+      auto it = ref.find(id);
+      ok = (v == NULL) == (it == ref.end()) && (!v || *v == it->second);
+    }
+    if (!ok || map.size() != ref.size()) {
+      std::cout << "OrderIdMap mismatch at op " << i << std::endl;
+      return false;
+    }
+  }
+
+  size_t seen = 0;
+  for (const auto& e : map) {
+    auto it = ref.find(e.first);
+    if (it == ref.end() || it->second != e.second) {
+      std::cout << "OrderIdMap iterates an entry it should not have" << std::endl;
+      return false;
+    }
+    seen++;
+  }
+  return seen == ref.size();
+}
+
+// every update type and every order must come back from Wire::decode(encode())
+// field for field
+static bool check_wire(uint64_t seed) {
+  std::mt19937_64 rng(seed);
+  for (size_t i = 0; i < 100000; i++) {
+    const ticker_t ticker = rng() % MAX_NUM_TICKERS;
+    const price_t price = (double)(rng() % 100000) / 100;
+    const quantity_t quantity = rng() % 10000 - 5000;
+    const order_id_t id = rng(), other = rng();
+    const bool buy = rng() & 1, ioc = rng() & 1;
+    const Common::RejectReason reason = (Common::RejectReason)(rng() % 9);
+
+    Common::Order o{ticker, price, quantity, buy, ioc, id, (trader_id_t)(rng() % 64)};
+    Common::Order od = Wire::decode(Wire::encode(o));
+    bool ok = od.ticker == o.ticker && od.price == o.price && od.quantity == o.quantity &&
+              od.buy == o.buy && od.ioc == o.ioc && od.order_id == o.order_id && od.trader_id == o.trader_id;
+
+    Update u;
+    u.type = (Common::UpdateType)(i % 5);
+    switch (u.type) {
+      case Common::TRADE: u.trade = Common::TradeUpdate{ticker, price, quantity, id, other, buy}; break;
+      case Common::ORDER: u.order = Common::OrderUpdate{ticker, price, quantity, id, buy}; break;
+      case Common::CANCEL: u.cancel = Common::CancelUpdate{ticker, id}; break;
+      case Common::REJECT_ORDER: u.reject_order = Common::RejectOrderUpdate{ticker, id, reason}; break;
+      case Common::REJECT_CANCEL: u.reject_cancel = Common::RejectCancelUpdate{ticker, id, reason}; break;
+    }
+    Update d = Wire::decode(Wire::encode(u));
+    ok = ok && d.type == u.type;
+    switch (u.type) {
+      case Common::TRADE:
+        ok = ok && d.trade.ticker == ticker && d.trade.price == price && d.trade.quantity == quantity &&
+             d.trade.resting_order_id == id && d.trade.aggressing_order_id == other && d.trade.buy == buy;
+        break;
+      case Common::ORDER:
+        ok = ok && d.order.ticker == ticker && d.order.price == price && d.order.quantity == quantity &&
+             d.order.order_id == id && d.order.buy == buy;
+        break;
+      case Common::CANCEL:
+        ok = ok && d.cancel.ticker == ticker && d.cancel.order_id == id;
+        break;
+      case Common::REJECT_ORDER:
+        ok = ok && d.reject_order.ticker == ticker && d.reject_order.order_id == id && d.reject_order.reason == reason;
+        break;
+      case Common::REJECT_CANCEL:
+        ok = ok && d.reject_cancel.ticker == ticker && d.reject_cancel.order_id == id && d.reject_cancel.reason == reason;
+        break;
+    }
+    if (!ok) {
+      std::cout << "Wire round trip lost a field at case " << i << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+// an order partly filled as the aggressor before its ORDER update must survive
+// expire_pending with its open quantity; one never heard of must not
+static bool check_own_orders() {
+  OwnOrders own;
+  const int64_t sent = now_ns();
+  own.on_sent(Common::Order{3, 100.0, 10, true, false, 1, 0}, sent);
+  own.on_sent(Common::Order{3, 100.0, 5, true, false, 2, 0}, sent);
+  own.on_sent(Common::Order{3, 100.0, 7, true, true, 3, 0}, sent);
+  own.on_fill(1, 4);
+  own.on_fill(3, 2); // an IOC: the rest is never heard of again
+
+  size_t expired = own.expire_pending(sent + 1);
+  const OwnOrder* o = own.find(1);
+  if (expired != 2 || !o || o->status != OwnOrder::PENDING_NEW || o->quantity != 6 ||
+      own.open_quantity(3, true) != 6 || own.on_side(3, true).size() != 1 || own.count(2) || own.count(3)) {
+    std::cout << "expire_pending dropped a replied order or kept a lost one" << std::endl;
+    return false;
+  }
+
+  own.on_resting(1, 6);
+  own.on_fill(1, 6);
+  if (own.size() != 0 || own.open_quantity(3, true) != 0 || !own.on_side(3, true).empty()) {
+    std::cout << "OwnOrders not empty after the last fill" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+template <typename Map>
+void id_map_cases(const std::string& label, const std::vector<order_id_t>& ids) {
+  Map map;
+  map.reserve(ids.size());
+  run_case(label + " insert", ids.size(), [&] {
+    for (order_id_t id : ids) {
+      map.emplace(id, id);
+    }
+  });
+  run_case(label + " find", ids.size(), [&] {
+    for (order_id_t id : ids) {
+      sink += map.count(id);
+    }
+  });
+  run_case(label + " erase", ids.size(), [&] {
+    for (order_id_t id : ids) {
+      map.erase(id);
+    }
+  });
+}
+
+
+// the feed event as the exchange would report it to a bot
+static Update to_update(const FeedEvent& e) {
+  Update u;
+  u.type = e.type;
+  switch (e.type) {
+    case Common::ORDER:
+      u.order = Common::OrderUpdate{0, e.price, e.quantity, e.order_id, e.buy};
+      break;
+    case Common::CANCEL:
+      u.cancel = Common::CancelUpdate{0, e.order_id};
+      break;
+    default:
+      u.trade = Common::TradeUpdate{0, e.price, e.quantity, e.order_id, 0, e.buy};
+      break;
+  }
+  return u;
+}
+
+static void apply(MyState& state, const Update& u) {
+  switch (u.type) {
+    case Common::TRADE: state.on_trade_update(u.trade); break;
+    case Common::ORDER: state.on_order_update(u.order); break;
+    case Common::CANCEL: state.on_cancel_update(u.cancel); break;
+    default: break;
+  }
+}
+
+static void deliver(MyBot& bot, Bot::Communicator& com, Update u) {
+  switch (u.type) {
+    case Common::TRADE: bot.on_trade_update(u.trade, com); break;
+    case Common::ORDER: bot.on_order_update(u.order, com); break;
+    case Common::CANCEL: bot.on_cancel_update(u.cancel, com); break;
+    case Common::REJECT_ORDER: bot.on_reject_order_update(u.reject_order, com); break;
+    case Common::REJECT_CANCEL: bot.on_reject_cancel_update(u.reject_cancel, com); break;
+  }
+}
+
+
+static int64_t bot_now = 0;
+
+void state_cases(const std::vector<Update>& updates, size_t queries) {
+  std::unique_ptr<MyState> state(new MyState());
+  int signal = state->add_signal(ImbalanceConfig{30, ImbalanceConfig::FLAT, 0.0, 10000});
+
+  run_case("state feed", updates.size(), [&] {
+    for (const Update& u : updates) {
+      apply(*state, u);
+    }
+  });
+  run_case("state get_pnl", queries, [&] {
+    for (size_t i = 0; i < queries; i++) {
+      sink += state->get_pnl();
+    }
+  });
+  run_case("state imbalance", queries, [&] {
+    for (size_t i = 0; i < queries; i++) {
+      sink += state->get_imbalance(0, signal);
+    }
+  });
+}
+
+// MyBot with its gateway in SIM mode, the clock `bot_now` and no stats prints
+static std::unique_ptr<MyBot> offline_bot() {
+  std::unique_ptr<MyBot> bot(new MyBot(1));
+  bot->order_mode = OrderGateway::SIM;
+  bot->clock = [] { return bot_now; };
+  bot->stats_interval_ns = 0;
+  return bot;
+}
+
+// starts a packet with the exchange's replies to the bot's own orders in it
+static void start_packet(MyBot& bot, Bot::Communicator& com, std::vector<Update>& replies) {
+  replies.clear();
+  bot.sim_replies(replies);
+  bot.on_packet_start(com);
+  for (const Update& u : replies) {
+    deliver(bot, com, u);
+  }
+}
+
+static void print_requotes(const MyBot& bot) {
+  std::cout << "  (" << bot.gateway.submit_latency.count() << " requotes, "
+            << bot.state.budget.dropped_count(Common::RATE_LIMIT_EXCEEDED) +
+               bot.state.budget.dropped_count(Common::OPEN_ORDERS_EXCEEDED) +
+               bot.state.budget.dropped_count(Common::POSITION_LIMIT_EXCEEDED)
+            << " actions over the limits, " << bot.state.own.size() << " orders left open)" << std::endl;
+}
+
+void bot_cases(const std::vector<Update>& updates, const char* capture_path) {
+  {
+    std::unique_ptr<MyBot> bot = offline_bot();
+    Bot::Communicator com = offline_communicator(*bot);
+    bot->init(com);
+    std::vector<Update> replies;
+
+    // 1ms per update, so the bot's 10ms self rate limit lets every 10th requote through
+    run_case("bot packet", updates.size(), [&] {
+      for (const Update& u : updates) {
+        bot_now += 1000000;
+        start_packet(*bot, com, replies);
+        deliver(*bot, com, u);
+        bot->on_packet_end(com);
+      }
+    });
+    print_requotes(*bot);
+  }
+
+  // bursts of 8 updates to a packet with no time throttle, requoting on every
+  // ORDER update or once per changed ticker at the end of the packet
+  for (bool conflate : {false, true}) {
+    std::unique_ptr<MyBot> bot = offline_bot();
+    Bot::Communicator com = offline_communicator(*bot);
+    bot->conflate = conflate;
+    bot->quote_params.min_interval_ns = 0;
+    bot->init(com);
+    std::vector<Update> replies;
+
+    run_case(conflate ? "bot 8/packet conflated" : "bot 8/packet", updates.size(), [&] {
+      for (size_t i = 0; i < updates.size(); ) {
+        bot_now += 8000000;
+        start_packet(*bot, com, replies);
+        for (size_t end = std::min(i + 8, updates.size()); i < end; i++) {
+          deliver(*bot, com, updates[i]);
+        }
+        bot->on_packet_end(com);
+      }
+    });
+    print_requotes(*bot);
+  }
+
+  if (!capture_path) {
+    return;
+  }
+  CaptureReader capture;
+  if (!capture.open(capture_path) || capture.size() == 0) {
+    return;
+  }
+
+  std::unique_ptr<MyBot> bot = offline_bot();
+  Bot::Communicator com = offline_communicator(*bot);
+  bot->init(com);
+  std::vector<Update> replies;
+
+  run_case("bot capture", capture.size(), [&] {
+    for (const CaptureRecord* r = capture.begin(); r != capture.end(); ) {
+      const uint64_t seq = r->packet_seq;
+      bot_now = r->packet_ns;
+      start_packet(*bot, com, replies);
+      for (; r != capture.end() && r->packet_seq == seq; r++) {
+        deliver(*bot, com, Wire::decode(r->update));
+      }
+      bot->on_packet_end(com);
+    }
+  });
+}
+
+
+int main(int argc, const char ** argv) {
+  size_t n = argc > 1 ? std::stoull(argv[1]) : 1000000;
+  uint64_t seed = argc > 2 ? std::stoull(argv[2]) : 42;
+  const char* capture_path = argc > 3 ? argv[3] : NULL;
+  const size_t queries = 1000000;
+
+  std::vector<FeedEvent> feed = make_feed(n, seed);
+  std::vector<FeedEvent> inserts;
+  for (const FeedEvent& e : feed) {
+    // quantity 1 orders would not survive the decrease_qty pass
+    if (e.type == Common::ORDER && e.quantity > 1 && inserts.size() < 100000) {
+      inserts.push_back(e);
+    }
+  }
+  std::vector<Update> updates;
+  for (const FeedEvent& e : feed) {
+    updates.push_back(to_update(e));
+  }
+
+  std::cout << "feed: " << feed.size() << " updates, seed " << seed << "; perf counters "
+            << (counters().available() ? "on" : "unavailable") << std::endl;
+
+  if (!check_id_map(seed) || !check_own_orders() || !check_wire(seed)) {
+    return 1;
+  }
+
+  book_cases<SetBook>("SetBook", feed, inserts, queries);
+  book_cases<LevelBook>("LevelBook", feed, inserts, queries);
+
+  std::vector<order_id_t> ids(100000);
+  std::mt19937_64 rng(seed);
+  for (order_id_t& id : ids) {
+    id = rng();
+  }
+  id_map_cases<OrderIdMap<order_id_t>>("OrderIdMap", ids);
+  id_map_cases<std::unordered_map<order_id_t, order_id_t>>("unordered_map", ids);
+
+  state_cases(updates, queries);
+  bot_cases(updates, capture_path);
+
+  return sink == 0.12345; // keep the reads alive
+}
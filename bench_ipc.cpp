@@ -0,0 +1,186 @@
+#include "kirin.hpp"
+#include "shm_ring.hpp"
+#include "spsc_ring.hpp"
+#include <iostream>
+#include <iomanip>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <boost/interprocess/ipc/message_queue.hpp>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+Round-trip latency of one Common::Order between two processes, over the
+transport kirin.o uses between bots and the exchange (a pair of
+boost::interprocess::message_queue, mutex and condition variable in shared
+memory) and over a pair of ShmRing whose ends spin a while before yielding
+(adaptive), yield straight away, or never yield (busy-poll).
+
+A forked echo process pops each message and pushes it straight back; the parent
+times send to reply.
+
+Busy polling only pays off when each process has a core to itself; with fewer
+cores than pollers every round trip waits out a scheduler tick, so it is off
+unless asked for.
+
+usage: ./bench_ipc [num_round_trips] [busy]
+*/
+
+
+const size_t RING_SIZE = 64;
+typedef ShmRing<Common::Order, RING_SIZE> OrderRing;
+
+const char* MQ_TO_ECHO = "bench_ipc_mq_req";
+const char* MQ_FROM_ECHO = "bench_ipc_mq_resp";
+const char* RING_TO_ECHO = "/bench_ipc_req";
+const char* RING_FROM_ECHO = "/bench_ipc_resp";
+
+
+static int64_t now_ns() {
+  using namespace std::chrono;
+  return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static Common::Order make_order(size_t i) {
+  return Common::Order{
+    .ticker = 0,
+    .price = 100.0,
+    .quantity = 1,
+    .buy = (i & 1) != 0,
+    .ioc = false,
+    .order_id = i,
+    .trader_id = 0
+  };
+}
+
+
+void report(const std::string& name, std::vector<int64_t> latencies) {
+  std::sort(latencies.begin(), latencies.end());
+
+  double total = 0.0;
+  for (int64_t x : latencies) {
+    total += x;
+  }
+
+  auto pct = [&](double p) {
+    return latencies[std::min(latencies.size() - 1, (size_t)(p * latencies.size()))];
+  };
+
+  std::cout << std::setw(14) << std::left << name
+            << " mean " << std::setw(8) << (int64_t)(total / latencies.size())
+            << " p50 " << std::setw(8) << pct(0.50)
+            << " p90 " << std::setw(8) << pct(0.90)
+            << " p99 " << std::setw(8) << pct(0.99)
+            << " p99.9 " << std::setw(8) << pct(0.999)
+            << " max " << latencies.back()
+            << "  (ns/round trip)" << std::endl;
+}
+
+
+std::vector<int64_t> bench_message_queue(size_t n) {
+  using namespace boost::interprocess;
+
+  message_queue::remove(MQ_TO_ECHO);
+  message_queue::remove(MQ_FROM_ECHO);
+  message_queue to_echo(create_only, MQ_TO_ECHO, RING_SIZE, sizeof(Common::Order));
+  message_queue from_echo(create_only, MQ_FROM_ECHO, RING_SIZE, sizeof(Common::Order));
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    message_queue in(open_only, MQ_TO_ECHO);
+    message_queue out(open_only, MQ_FROM_ECHO);
+    Common::Order order;
+    message_queue::size_type size;
+    unsigned int priority;
+    for (size_t i = 0; i < n; i++) {
+      in.receive(&order, sizeof(order), size, priority);
+      out.send(&order, sizeof(order), 0);
+    }
+    _exit(0);
+  }
+
+  std::vector<int64_t> latencies;
+  latencies.reserve(n);
+  Common::Order order;
+  message_queue::size_type size;
+  unsigned int priority;
+
+  for (size_t i = 0; i < n; i++) {
+    Common::Order sent = make_order(i);
+    int64_t t0 = now_ns();
+    to_echo.send(&sent, sizeof(sent), 0);
+    from_echo.receive(&order, sizeof(order), size, priority);
+    latencies.push_back(now_ns() - t0);
+  }
+
+  waitpid(pid, NULL, 0);
+  message_queue::remove(MQ_TO_ECHO);
+  message_queue::remove(MQ_FROM_ECHO);
+  return latencies;
+}
+
+
+std::vector<int64_t> bench_shm_ring(size_t n, int spin_limit) {
+  OrderRing to_echo, from_echo;
+  if (!to_echo.create(RING_TO_ECHO) || !from_echo.create(RING_FROM_ECHO)) {
+    return {};
+  }
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    OrderRing in, out;
+    if (!in.open(RING_TO_ECHO) || !out.open(RING_FROM_ECHO)) {
+      _exit(1);
+    }
+    SpinWait waiter(spin_limit);
+    Common::Order order;
+    for (size_t i = 0; i < n; i++) {
+      in.pop(order, waiter);
+      out.push(order, waiter);
+    }
+    _exit(0);
+  }
+
+  std::vector<int64_t> latencies;
+  latencies.reserve(n);
+  SpinWait waiter(spin_limit);
+  Common::Order order;
+
+  for (size_t i = 0; i < n; i++) {
+    Common::Order sent = make_order(i);
+    int64_t t0 = now_ns();
+    to_echo.push(sent, waiter);
+    from_echo.pop(order, waiter);
+    latencies.push_back(now_ns() - t0);
+  }
+
+  waitpid(pid, NULL, 0);
+  return latencies;
+}
+
+
+int main(int argc, const char ** argv) {
+  size_t n = argc > 1 ? std::stoull(argv[1]) : 100000;
+  bool busy = argc > 2 && std::string(argv[2]) == "busy";
+
+  std::cout << "round trips: " << n << ", cores: " << std::thread::hardware_concurrency() << std::endl;
+
+  report("message_queue", bench_message_queue(n));
+
+  std::vector<int64_t> adaptive = bench_shm_ring(n, SpinWait::ADAPTIVE);
+  if (adaptive.empty()) {
+    return 1;
+  }
+  report("shm adaptive", adaptive);
+  report("shm yield", bench_shm_ring(n, 0));
+
+  if (busy) {
+    report("shm busy-poll", bench_shm_ring(n, SpinWait::BUSY_POLL));
+  }
+
+  return 0;
+}
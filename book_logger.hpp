@@ -0,0 +1,200 @@
+#pragma once
+
+#include "kirin.hpp"
+#include "latency.hpp"
+#include "level_book.hpp"
+#include "price.hpp"
+#include "spsc_ring.hpp"
+#include <cstdio>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+
+// one fixed-size entry of the book log; a snapshot is SNAPSHOT, then LEVEL and
+// OWN_ORDER entries, then SNAPSHOT_END
+struct BookLogRecord {
+  enum Kind : uint8_t { TRADE, ORDER, CANCEL, SNAPSHOT, LEVEL, OWN_ORDER, SNAPSHOT_END };
+
+  int64_t t_ns;
+  uint64_t seq;       // update number; a snapshot carries the one it follows
+  tick_t tick;
+  quantity_t quantity;
+  order_id_t order_id;
+  uint32_t count;     // orders at the level, LEVEL only
+  Kind kind;
+  ticker_t ticker;
+  bool buy;
+};
+
+
+/*
+Book logging that stays on in production, in place of LevelBook::print_book.
+
+The strategy thread only fills fixed-size BookLogRecords and pushes them into an
+SpscRing: one per book update, plus a snapshot of the top snapshot_levels levels
+of each side (and our own open orders) every snapshot_every updates of a ticker,
+instead of a full dump of every order after every update. A background thread
+formats the records as text and writes them out through stdio buffering,
+flushing whenever it runs dry.
+
+Nothing on the strategy side allocates, locks or blocks: when the ring is full
+the record is dropped and counted, and the log says how many were lost.
+*/
+class BookLogger {
+public:
+  BookLogger() :
+    out(NULL), running(false), seq(0), snapshot_every(1000), snapshot_levels(10),
+    dropped(0), since_snapshot() {}
+
+  ~BookLogger() {
+    stop();
+  }
+
+  bool start(const std::string& path, uint64_t every = 1000, int levels = 10) {
+    stop();
+
+    out = fopen(path.c_str(), "a");
+    if (!out) {
+      perror(("fopen " + path).c_str());
+      return false;
+    }
+    setvbuf(out, NULL, _IOFBF, 1 << 20);
+
+    snapshot_every = every;
+    snapshot_levels = levels;
+    running = true;
+    writer = std::thread(&BookLogger::run, this);
+    return true;
+  }
+
+  // writes out whatever is still queued
+  void stop() {
+    if (running.exchange(false)) {
+      writer.join();
+    }
+    if (out) {
+      fclose(out);
+      out = NULL;
+    }
+  }
+
+  bool enabled() const {
+    return out != NULL;
+  }
+
+  // one book update, and a snapshot of that ticker's book if one is due;
+  // `mine` is the open order map
+  template <typename Orders>
+  void on_update(BookLogRecord::Kind kind, ticker_t ticker, tick_t tick, quantity_t quantity,
+                 order_id_t order_id, bool buy, const LevelBook& book, const Orders& mine) {
+    const int64_t t = now_ns();
+    push(BookLogRecord{t, ++seq, tick, quantity, order_id, 0, kind, ticker, buy});
+
+    if (++since_snapshot[ticker] >= snapshot_every) {
+      since_snapshot[ticker] = 0;
+      snapshot(t, ticker, book, mine);
+    }
+  }
+
+private:
+  template <typename Orders>
+  void snapshot(int64_t t, ticker_t ticker, const LevelBook& book, const Orders& mine) {
+    push(BookLogRecord{t, seq, 0, 0, 0, 0, BookLogRecord::SNAPSHOT, ticker, false});
+
+    for (bool buy : {false, true}) {
+      int n = 0;
+      book.for_each_level(buy, [&](tick_t tick, quantity_t quantity, uint32_t count) {
+        push(BookLogRecord{t, seq, tick, quantity, 0, count, BookLogRecord::LEVEL, ticker, buy});
+        return ++n < snapshot_levels;
+      });
+    }
+
+    for (const auto& x : mine) {
+      const Common::Order& order = x.second;
+      if (order.ticker == ticker) {
+        push(BookLogRecord{t, seq, px_t::from_price(order.price).ticks, order.quantity, x.first, 0,
+                           BookLogRecord::OWN_ORDER, ticker, order.buy});
+      }
+    }
+
+    push(BookLogRecord{t, seq, 0, 0, 0, 0, BookLogRecord::SNAPSHOT_END, ticker, false});
+  }
+
+  void push(const BookLogRecord& r) {
+    if (!ring.try_push(r)) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  void run() {
+    BookLogRecord r;
+    uint64_t reported_dropped = 0;
+
+    for (;;) {
+      bool stopping = !running.load(std::memory_order_acquire);
+
+      while (ring.try_pop(r)) {
+        write(r);
+      }
+
+      uint64_t d = dropped.load(std::memory_order_relaxed);
+      if (d != reported_dropped) {
+        fprintf(out, "dropped %llu records\n", (unsigned long long)(d - reported_dropped));
+        reported_dropped = d;
+      }
+      fflush(out);
+
+      if (stopping) {
+        return;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+  void write(const BookLogRecord& r) {
+    const double price = px_t::from_ticks(r.tick).to_price();
+    const char side = r.buy ? 'B' : 'S';
+
+    switch (r.kind) {
+      case BookLogRecord::TRADE:
+      case BookLogRecord::ORDER:
+      case BookLogRecord::CANCEL: {
+        static const char* names[] = {"trade", "order", "cancel"};
+        fprintf(out, "%llu %lld %s ticker=%d %c %.2f x %lld id=%llu\n",
+                (unsigned long long)r.seq, (long long)r.t_ns, names[r.kind], r.ticker, side, price,
+                (long long)r.quantity, (unsigned long long)r.order_id);
+        break;
+      }
+      case BookLogRecord::SNAPSHOT:
+        fprintf(out, "snapshot after %llu ticker=%d\n", (unsigned long long)r.seq, r.ticker);
+        break;
+      case BookLogRecord::LEVEL:
+        fprintf(out, "  %c %.2f x %lld (%u orders)\n", side, price, (long long)r.quantity, r.count);
+        break;
+      case BookLogRecord::OWN_ORDER:
+        fprintf(out, "  mine %c %.2f x %lld id=%llu\n", side, price, (long long)r.quantity,
+                (unsigned long long)r.order_id);
+        break;
+      case BookLogRecord::SNAPSHOT_END:
+        fprintf(out, "EOF\n");
+        break;
+    }
+  }
+
+  FILE* out;
+  std::thread writer;
+  std::atomic<bool> running;
+
+  // strategy thread only
+  uint64_t seq;
+  uint64_t snapshot_every;
+  int snapshot_levels;
+
+  std::atomic<uint64_t> dropped;
+  uint64_t since_snapshot[MAX_NUM_TICKERS];
+
+  SpscRing<BookLogRecord, 1 << 14> ring;
+};
@@ -0,0 +1,207 @@
+#pragma once
+
+#include "kirin.hpp"
+#include "packet_bot.hpp"
+#include "wire.hpp"
+#include <cstdio>
+#include <cstring>
+
+#include <string>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/*
+Binary capture of the updates a bot receives, one fixed-size record per update.
+
+A capture file is a CaptureHeader followed by `count` CaptureRecords, each update
+stored as a Wire::Update (56 bytes a record, where the Update itself would take
+72). The header carries both CAPTURE_VERSION (header and record layout) and
+Wire::WIRE_VERSION (the update inside each record), and a reader refuses a file
+where either differs from what it was built with. The writer sizes and allocates
+the whole file up front and maps it, so appending is a memcpy into the mapping;
+the header's count is bumped once per packet, which keeps the file readable even
+if the process is killed mid-session (the kernel still writes back a shared
+mapping). A full file drops further packets and counts them in `dropped`.
+*/
+struct CaptureHeader {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t record_size;
+  uint32_t wire_version; // Wire::WIRE_VERSION of the records' updates
+  uint32_t reserved;
+  uint64_t capacity; // records the file has room for
+  uint64_t count;    // records written
+  uint64_t dropped;  // updates that did not fit
+};
+
+struct CaptureRecord {
+  int64_t packet_ns;   // when the packet holding this update started arriving
+  uint64_t packet_seq; // updates of one packet share it, in order
+  Wire::Update update; // Wire::decode() gives the Update back
+};
+
+static_assert(std::is_trivially_copyable<CaptureRecord>::value, "CaptureRecord is written to disk as is");
+static_assert(sizeof(CaptureHeader) == 48 && sizeof(CaptureRecord) == 56 &&
+              offsetof(CaptureRecord, update) == 16,
+              "capture layout changed, bump CAPTURE_VERSION");
+
+const uint64_t CAPTURE_MAGIC = 0x5041434e4952494bULL; // "KIRINCAP"
+// 1: Update records; 2: Wire::Update records; 3: the header names the wire version
+const uint32_t CAPTURE_VERSION = 3;
+
+
+class CaptureWriter {
+public:
+  CaptureWriter() : header(NULL), records(NULL), map_size(0), packet_seq(0) {}
+
+  ~CaptureWriter() {
+    close();
+  }
+
+  CaptureWriter(const CaptureWriter&) = delete;
+  CaptureWriter& operator=(const CaptureWriter&) = delete;
+
+  bool open(const std::string& path, uint64_t capacity = 1 << 22) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      perror(("open " + path).c_str());
+      return false;
+    }
+
+    map_size = sizeof(CaptureHeader) + capacity * sizeof(CaptureRecord);
+    int err = posix_fallocate(fd, 0, map_size);
+    if (err != 0) {
+      fprintf(stderr, "posix_fallocate %s: %s\n", path.c_str(), strerror(err));
+      ::close(fd);
+      return false;
+    }
+
+    void* p = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+      perror(("mmap " + path).c_str());
+      return false;
+    }
+
+    header = static_cast<CaptureHeader*>(p);
+    records = reinterpret_cast<CaptureRecord*>(header + 1);
+    *header = CaptureHeader{CAPTURE_MAGIC, CAPTURE_VERSION, sizeof(CaptureRecord), Wire::WIRE_VERSION, 0,
+                            capacity, 0, 0};
+    return true;
+  }
+
+  void close() {
+    if (header) {
+      munmap(header, map_size);
+      header = NULL;
+      records = NULL;
+    }
+  }
+
+  bool is_open() const {
+    return header != NULL;
+  }
+
+  // appends one packet's updates; all or nothing
+  void append_packet(int64_t packet_ns, const Update* updates, size_t n) {
+    const uint64_t count = header->count;
+    if (header->capacity - count < n) {
+      header->dropped += n;
+      return;
+    }
+
+    packet_seq++;
+    for (size_t i = 0; i < n; i++) {
+      CaptureRecord& r = records[count + i];
+      r.packet_ns = packet_ns;
+      r.packet_seq = packet_seq;
+      r.update = Wire::encode(updates[i]);
+    }
+    header->count = count + n;
+  }
+
+private:
+  CaptureHeader* header;
+  CaptureRecord* records;
+  size_t map_size;
+  uint64_t packet_seq;
+};
+
+
+class CaptureReader {
+public:
+  CaptureReader() : header(NULL), map_size(0) {}
+
+  ~CaptureReader() {
+    if (header) {
+      munmap(const_cast<CaptureHeader*>(header), map_size);
+    }
+  }
+
+  CaptureReader(const CaptureReader&) = delete;
+  CaptureReader& operator=(const CaptureReader&) = delete;
+
+  bool open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      perror(("open " + path).c_str());
+      return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CaptureHeader)) {
+      fprintf(stderr, "%s: not a capture file\n", path.c_str());
+      ::close(fd);
+      return false;
+    }
+
+    map_size = st.st_size;
+    void* p = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+      perror(("mmap " + path).c_str());
+      return false;
+    }
+    header = static_cast<const CaptureHeader*>(p);
+
+    if (header->magic != CAPTURE_MAGIC || header->version != CAPTURE_VERSION ||
+        header->record_size != sizeof(CaptureRecord) ||
+        sizeof(CaptureHeader) + header->count * sizeof(CaptureRecord) > map_size) {
+      fprintf(stderr, "%s: not a version %u capture file\n", path.c_str(), CAPTURE_VERSION);
+      return false;
+    }
+    if (header->wire_version != Wire::WIRE_VERSION) {
+      fprintf(stderr, "%s: updates in wire version %u, this build reads %u\n", path.c_str(),
+              header->wire_version, Wire::WIRE_VERSION);
+      return false;
+    }
+    return true;
+  }
+
+  const CaptureRecord* begin() const {
+    return reinterpret_cast<const CaptureRecord*>(header + 1);
+  }
+
+  const CaptureRecord* end() const {
+    return begin() + header->count;
+  }
+
+  uint64_t size() const {
+    return header->count;
+  }
+
+  uint64_t dropped() const {
+    return header->dropped;
+  }
+
+private:
+  const CaptureHeader* header;
+  size_t map_size;
+};
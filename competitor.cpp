@@ -1,4 +1,16 @@
 #include "kirin.hpp"
+#include "latency.hpp"
+#include "book_logger.hpp"
+#include "capture.hpp"
+#include "level_book.hpp"
+#include "price.hpp"
+#include "signal.hpp"
+#include "ticker_registry.hpp"
+#include "order_gateway.hpp"
+#include "thread_policy.hpp"
+#include "own_orders.hpp"
+#include "order_budget.hpp"
+#include "packet_bot.hpp"
 #include <cassert>
 #include <iostream>
 #include <iomanip>
@@ -8,363 +20,306 @@
 #include <chrono>
 #include <set>
 #include <unordered_map>
-#include <unordered_set>
 
 
-struct LimitOrder {
-  price_t price;
-  mutable quantity_t quantity; // mutable so set doesn't complain
-  order_id_t order_id;
-  long long time;
-  trader_id_t trader_id;
-  bool buy;
+typedef LevelBook MyBook;
 
-  bool operator <(const LimitOrder& other) const {
-    // < means more aggressive
-    if (buy) {
-      return price > other.price || (price == other.price && time < other.time);
-    } else {
-      return price < other.price || (price == other.price && time < other.time);
-    }
-  }
 
-  bool trades_with(const LimitOrder& other) const {
-    return ((buy && !other.buy && price >= other.price) ||
-            (!buy && other.buy && price <= other.price));
-  }
+// how MyBot quotes one ticker
+struct QuoteParams {
+  bool enabled = false;               // quoted at all
+  quantity_t size = 40;               // per side
+  double threshold = 0.2;             // |imbalance| it takes to quote
+  int64_t min_interval_ns = 10000000; // between two requotes of the ticker
 };
 
 
-struct MyBook {
-public:
-
-  MyBook() {}
-
-  price_t get_bbo(bool buy) const {
-    const std::set<LimitOrder>& side = sides[buy];
-
-    if (side.empty()) {
-      return 0.0;
-    }
-    return side.begin()->price;
+// everything MyState keeps per ticker; only exists for tickers seen or configured
+struct TickerState {
+  TickerState(ticker_t ticker) :
+    ticker(ticker), position(0), avg_cost(0.0), held_index(-1), unacked_qty(),
+    last_trade_price(px_t::from_price(100.0)), last_quote_ns(0) {
+    book.set_listener(&signals);
   }
 
-  price_t get_2nd_bbo(bool buy) const {
-    const std::set<LimitOrder>&  side = sides[buy];
+  ticker_t ticker;
+  MyBook book;
+  SignalEngine signals; // fed by the book's level changes
+  quantity_t position;
+  price_t avg_cost;     // of the open position, 0 when flat
+  int held_index;       // position in MyState::held, -1 if flat
+  quantity_t unacked_qty[2]; // admitted orders by side (buy = 1) not in MyState::own yet
+  px_t last_trade_price;
+
+  QuoteParams quote;
+  int64_t last_quote_ns; // packet time of the last requote
+};
 
-    if (side.empty()) {
-      return 0.0;
-    }
 
-    std::set<LimitOrder>::iterator s = sides[buy].begin();
-    s++;
-    return (s->price);
+struct MyState {
+  MyState(trader_id_t trader_id) :
+    trader_id(trader_id), own(), budget(), unacked(0),
+    volume_traded(), realized_pnl() {
+    own.reserve(TraderLimits::MAX_OPEN_ORDERS);
   }
 
-  /* ---USE THIS FUNCTION TO GENERATE A SIGNAL---
-  Currently, I calculate bid and ask volume for 8 levels.
-  I then calculate (bid_vol - ask_vol)/(bid_vol + ask_vol). 
-  I also weight volumes by the number of levels away they are from the touch point.
-  */
-  double get_signal(int num_levels) const {
-    bool bid = true, ask = false;
-    price_t best_bid = get_bbo(bid);
-    price_t best_offer = get_bbo(ask);
+  MyState() : MyState(0) {}
 
-    double signal = 0.0;
+  // returns whether one of our orders traded
+  bool on_trade_update(const Common::TradeUpdate& update) {
+    const px_t price = px_t::from_price(update.price);
 
-    if (best_bid == 0.0 || best_offer == 0.0) {
-      return signal; // no signal can be found in this case
-    }
+    TickerState& ts = ticker(update.ticker);
+    ts.last_trade_price = price;
+    ts.book.decrease_qty(update.resting_order_id, update.quantity);
 
-    double weight;
-    // Calculate bid volume for up to n levels
-    quantity_t bid_volume = 0;
-    std::set<LimitOrder>::iterator bid_level=sides[1].begin();
-    for (int i = 0; i<num_levels && bid_level!=sides[1].end(); i++) {
-      if (bid_level -> quantity > 10000) {
-        bid_level++;
-        continue;
-      }
-      weight = 1 - abs(best_bid - bid_level->price)/best_bid;
-      bid_volume += weight * (bid_level->quantity);
-      bid_level++;
-    }
+    const bool resting_mine = own.on_fill(update.resting_order_id, update.quantity);
+    const bool aggressor_mine = own.on_fill(update.aggressing_order_id, update.quantity);
 
-    // Calculate ask volume for up to n levels
-    quantity_t ask_volume = 0;
-    std::set<LimitOrder>::iterator ask_level=sides[0].begin();
-    for (int i = 0; i<num_levels && ask_level!=sides[0].end(); i++) {
-      if (ask_level -> quantity > 10000) {
-        ask_level++;
-        continue;
-      }
-      weight = 1 - abs(ask_level->price - best_offer)/best_offer;
-      ask_volume += weight * (ask_level->quantity);
-      ask_level++;
+    // a self-trade leaves the position alone
+    if (resting_mine && !aggressor_mine) {
+      volume_traded += update.quantity;
+      update_position(ts, price,
+                      update.buy ? -update.quantity : update.quantity); // opposite, since resting
+    } else if (aggressor_mine && !resting_mine) {
+      volume_traded += update.quantity;
+      update_position(ts, price,
+                      update.buy ? update.quantity : -update.quantity);
     }
 
-    // Calculate signal
-    signal = ((double)bid_volume - (double)ask_volume)/((double)bid_volume + (double)ask_volume);
-
-    return signal;
-  }
-
-  price_t get_mid_price(price_t default_to) const {
-    price_t best_bid = get_bbo(true);
-    price_t best_offer = get_bbo(false);
-
-    if (best_bid == 0.0 || best_offer == 0.0) {
-      return default_to;
+    if (logger.enabled()) {
+      logger.on_update(BookLogRecord::TRADE, update.ticker, price.ticks, update.quantity,
+                       update.resting_order_id, update.buy, ts.book, own);
     }
 
-    return 0.5 * (best_bid + best_offer);
-
+    return resting_mine || aggressor_mine;
   }
 
+  /* Books one of our fills. Positions are carried at average cost: a fill that
+  adds to (or opens) a position moves the average, one that reduces it realizes
+  (price - average) on the closed quantity, and one that flips it closes the old
+  position and opens the rest at the fill price.
+  */
+  void update_position(TickerState& ts, px_t price, quantity_t delta_quantity) {
+    const price_t p = price.to_price();
+    quantity_t& position = ts.position;
+    price_t& avg = ts.avg_cost;
 
-  void insert(Common::Order order_to_insert) {
-
-    LimitOrder order_left = {
-      .price = order_to_insert.price,
-      .quantity = order_to_insert.quantity,
-      .order_id = order_to_insert.order_id,
-      .time = std::chrono::steady_clock::now().time_since_epoch().count(),
-      .trader_id = order_to_insert.trader_id,
-      .buy = order_to_insert.buy
-    };
-
-    auto& side = sides[(size_t)order_left.buy];
-
-    auto it_new = side.insert(order_left);
-    assert(it_new.second);
-    order_map[order_left.order_id] = it_new.first;
-
-  }
-
-  void cancel(trader_id_t trader_id, order_id_t order_id) {
-
-
-    if (!order_map.count(order_id)) {
-      std::cout << "order " << order_id << " nonexistent" << std::endl;
+    if (delta_quantity == 0) {
       return;
     }
-    auto it = order_map[order_id];
-
-    order_map.erase(order_id);
-
-    auto& side = sides[(size_t)it->buy];
-    side.erase(it);
-  }
-
-  quantity_t decrease_qty(order_id_t order_id, quantity_t decrease_by) {
-
-    if (!order_map.count(order_id)) {
-      return -1;
-    }
-
-    std::set<LimitOrder>::iterator it = order_map[order_id];
-
-    if (decrease_by >= it->quantity) {
-      order_map.erase(order_id);
-      std::set<LimitOrder>& side = sides[(size_t)it->buy];
-      side.erase(it);
-      return 0;
 
+    if (position == 0 || (position > 0) == (delta_quantity > 0)) {
+      avg = (avg * position + p * delta_quantity) / (position + delta_quantity);
     } else {
-
-      it->quantity -= decrease_by;
-      return it->quantity;
+      quantity_t closed = std::min(std::abs(position), std::abs(delta_quantity));
+      realized_pnl += (p - avg) * (position > 0 ? closed : -closed);
+      if (std::abs(delta_quantity) > std::abs(position)) {
+        avg = p;
+      }
     }
 
+    position += delta_quantity;
+
+    if (position == 0) {
+      avg = 0.0;
+      if (ts.held_index >= 0) {
+        // swap-remove from held
+        TickerState* last = held.back();
+        held[ts.held_index] = last;
+        last->held_index = ts.held_index;
+        held.pop_back();
+        ts.held_index = -1;
+      }
+    } else if (ts.held_index < 0) {
+      ts.held_index = held.size();
+      held.push_back(&ts);
+    }
   }
 
-  void print_book(std::string fp, const std::unordered_map<order_id_t, Common::Order>& mine={}) {
-    if (fp == "") {
-      return;
-    }
+  void on_order_update(const Common::OrderUpdate& update) {
+    const px_t price = px_t::from_price(update.price);
+    TickerState& ts = ticker(update.ticker);
+    ts.book.insert(price, update.quantity, update.order_id, update.buy);
 
-    std::ofstream fout(fp, std::fstream::app);
+    own.on_resting(update.order_id, update.quantity);
 
-    fout << "offers\n";
-    for (auto rit = sides[0].rbegin(); rit != sides[0].rend(); rit++) {
-      auto x = *rit;
-      fout << x.price << ' ' << x.quantity;
-      if (mine.count(x.order_id)) {
-        fout << " (mine)";
-      }
-      fout << '\n';
+    if (logger.enabled()) {
+      logger.on_update(BookLogRecord::ORDER, update.ticker, price.ticks, update.quantity,
+                       update.order_id, update.buy, ts.book, own);
     }
+  }
 
-    fout << "\nbids\n";
+  void on_cancel_update(const Common::CancelUpdate& update) {
+    TickerState& ts = ticker(update.ticker);
+    ts.book.cancel(trader_id, update.order_id);
 
-    for (auto& x : sides[1]) {
-      fout << x.price << ' ' << x.quantity;
-      if (mine.count(x.order_id)) {
-        fout << " (mine)";
-      }
-      fout << '\n';
-    }
+    own.on_cancelled(update.order_id);
 
-    fout << "EOF" << std::endl;
+    if (logger.enabled()) {
+      logger.on_update(BookLogRecord::CANCEL, update.ticker, 0, 0,
+                       update.order_id, false, ts.book, own);
+    }
+  }
 
+  void on_reject_order_update(const Common::RejectOrderUpdate& update) {
+    own.on_rejected(update.order_id);
+  }
 
-    fout.close();
+  void on_reject_cancel_update(const Common::RejectCancelUpdate& update) {
+    own.on_cancel_rejected(update.order_id);
   }
 
-  quantity_t quote_size(bool buy) {
-    price_t p = get_bbo(buy);
-    if (p == 0.0) {
-      return 0;
-    }
+  void on_place_order(const Common::Order& order, int64_t sent_ns) {
+    own.on_sent(order, sent_ns);
+  }
 
-    quantity_t ans = 0;
-    for (auto& x : sides[buy]) {
-      if (x.price != p) {
-        break;
-      }
-      ans += x.quantity;
+  /* Whether a new order may go out at `now`: if the exchange would reject it
+  (see OrderBudget) it is counted as dropped and false is returned, otherwise it
+  is charged to the rate limit.
+  An admitted order only reaches `own` once the gateway hands its id back, which
+  in ASYNC mode can be a packet or more later; until then (on_acked) it is
+  counted here, so back-to-back requotes cannot overshoot the limits.
+  */
+  bool admit_order(const Common::Order& order, int64_t now) {
+    TickerState& ts = ticker(order.ticker);
+    Common::RejectReason reason =
+      budget.check_order(order, ts.position, own.open_quantity(order.ticker, order.buy) + ts.unacked_qty[order.buy],
+                         own.size() + unacked, now);
+    if (reason != Common::NO_REASON) {
+      budget.on_dropped(reason);
+      return false;
     }
-    return ans;
+    budget.on_action(now);
+    ts.unacked_qty[order.buy] += order.quantity;
+    unacked++;
+    return true;
   }
-  price_t spread() {
 
-    price_t best_bid = get_bbo(true);
-    price_t best_offer = get_bbo(false);
+  // the gateway sent an admitted order (SIM included) and gave back its id
+  void on_acked(const Common::Order& order) {
+    ticker(order.ticker).unacked_qty[order.buy] -= order.quantity;
+    unacked--;
+  }
 
-    if (best_bid == 0.0 || best_offer == 0.0) {
-      return 0.0;
+  // the same for a cancel, which is also refused if the order is not resting or
+  // already has a cancel in flight; if admitted the order becomes PENDING_CANCEL
+  bool on_place_cancel(const Common::Cancel& cancel, int64_t now) {
+    Common::RejectReason reason = budget.check_cancel(own.size(), now);
+    if (reason != Common::NO_REASON) {
+      budget.on_dropped(reason);
+      return false;
     }
-
-    return best_offer - best_bid;
+    if (!own.on_cancel_sent(cancel.order_id)) {
+      return false;
+    }
+    budget.on_action(now);
+    return true;
   }
 
-private:
-  std::set<LimitOrder> sides[2];
-  std::unordered_map<order_id_t, std::set<LimitOrder>::iterator> order_map;
-};
-
-
-struct MyState {
-  MyState(trader_id_t trader_id) :
-    trader_id(trader_id), books(), submitted(), open_orders(),
-    cash(), positions(), volume_traded(), last_trade_price(100.0),
-    log_path("") {}
-
-  MyState() : MyState(0) {}
-
-  void on_trade_update(const Common::TradeUpdate& update) {
-    last_trade_price = update.price;
-
-    books[update.ticker].decrease_qty(update.resting_order_id, update.quantity);
-    books[update.ticker].print_book(log_path, open_orders);
+  // cancels sent that the exchange has not answered yet
+  size_t cancels_in_flight() const {
+    return own.in_status(OwnOrder::PENDING_CANCEL);
+  }
 
-    if (submitted.count(update.resting_order_id)) {
 
-      if (!submitted.count(update.aggressing_order_id)) {
-        volume_traded += update.quantity;
-        // not a self-trade
-        update_position(update.ticker, update.price,
-                        update.buy ? -update.quantity : update.quantity); // opposite, since resting
+  std::unordered_map<px_t, std::vector<Common::Order>> levels() const {
+    std::unordered_map<px_t, std::vector<Common::Order>> levels;
+    for (const auto& p : own) {
+      const OwnOrder& order = p.second;
+      if (order.status != OwnOrder::PENDING_NEW) {
+        levels[px_t::from_price(order.price)].push_back(order);
       }
-
-      open_orders[update.resting_order_id].quantity -= update.quantity;
-      if (open_orders[update.resting_order_id].quantity <= 0) {
-        open_orders.erase(update.resting_order_id);
-      }
-
-    } else if (submitted.count(update.aggressing_order_id)) {
-      volume_traded += update.quantity;
-
-      update_position(update.ticker, update.price,
-                      update.buy ? update.quantity : -update.quantity);
     }
+    return levels;
   }
 
-  void update_position(ticker_t ticker, price_t price, quantity_t delta_quantity) {
-    cash -= price * delta_quantity;
-    positions[ticker] += delta_quantity;
+  // realized + unrealized; only looks at tickers we hold a position in
+  price_t get_pnl() const {
+    return get_realized_pnl() + get_unrealized_pnl();
   }
 
-  void on_order_update(const Common::OrderUpdate& update) {
-
-    const Common::Order order{
-      .ticker = update.ticker,
-      .price = update.price,
-      .quantity = update.quantity,
-      .buy = update.buy,
-      .ioc = false,
-      .order_id = update.order_id,
-      .trader_id = trader_id
-    };
-
-    books[update.ticker].insert(order);
-    books[update.ticker].print_book(log_path, open_orders);
-
-    if (submitted.count(update.order_id)) {
-      open_orders[update.order_id] = order;
-    }
+  // from closed quantity, at average cost
+  price_t get_realized_pnl() const {
+    return realized_pnl;
   }
 
-  void on_cancel_update(const Common::CancelUpdate& update) {
-    books[update.ticker].cancel(trader_id, update.order_id);
-    books[update.ticker].print_book(log_path, open_orders);
-
-    if (open_orders.count(update.order_id)) {
-      open_orders.erase(update.order_id);
+  // open positions marked to their book's mid (their last trade price when it has none)
+  price_t get_unrealized_pnl() const {
+    price_t pnl = 0.0;
 
+    for (const TickerState* ts : held) {
+      pnl += ts->position * (ts->book.get_mid_price(ts->last_trade_price.to_price()) - ts->avg_cost);
     }
 
-    submitted.erase(update.order_id);
+    return pnl;
   }
 
-  void on_place_order(const Common::Order& order) {
-    submitted.insert(order.order_id);
+  px_t get_bbo(ticker_t ticker, bool buy) {
+    return book(ticker).get_bbo(buy);
   }
 
+  // the state of a ticker, set up (with every registered signal) on first use;
+  // init() should call it for the tickers it trades so that happens early
+  TickerState& ticker(ticker_t t) {
+    TickerState* ts = tickers.find(t);
+    if (ts) {
+      return *ts;
+    }
 
-  std::unordered_map<price_t, std::vector<Common::Order>> levels() const {
-    std::unordered_map<price_t, std::vector<Common::Order>> levels;
-    for (const auto& p : open_orders) {
-      const Common::Order& order = p.second;
-      levels[order.price].push_back(order);
+    TickerState& fresh = tickers.get(t);
+    for (const ImbalanceConfig& config : signal_configs) {
+      fresh.signals.add(config);
     }
-    return levels;
+    return fresh;
   }
 
-  price_t get_pnl() const {
-    price_t pnl = cash;
+  MyBook& book(ticker_t t) {
+    return ticker(t).book;
+  }
 
-    for (int i = 0; i < MAX_NUM_TICKERS; i++) {
-      pnl += positions[i] * books[i].get_mid_price(last_trade_price);
-    }
+  quantity_t position(ticker_t t) const {
+    const TickerState* ts = tickers.find(t);
+    return ts ? ts->position : 0;
+  }
 
-    return pnl;
+  // registers an imbalance variant on every ticker, now and later; returns its index
+  int add_signal(const ImbalanceConfig& config) {
+    signal_configs.push_back(config);
+    for (size_t i = 0; i < tickers.size(); i++) {
+      tickers.at(i).signals.add(config);
+      tickers.at(i).signals.refresh(tickers.at(i).book);
+    }
+    return signal_configs.size() - 1;
   }
 
-  price_t get_bbo(ticker_t ticker, bool buy) {
-    return books[ticker].get_bbo(buy);
+  // 0 for a ticker that has not been seen
+  double get_imbalance(ticker_t ticker, int variant) const {
+    const TickerState* ts = tickers.find(ticker);
+    return ts ? ts->signals.imbalance(variant) : 0.0;
   }
 
   trader_id_t trader_id;
-  MyBook books[MAX_NUM_TICKERS];
-  std::unordered_set<order_id_t> submitted;
-  std::unordered_map<order_id_t, Common::Order> open_orders;
-  price_t cash;
-  quantity_t positions[MAX_NUM_TICKERS];
+  TickerRegistry<TickerState> tickers;
+  std::vector<ImbalanceConfig> signal_configs;
+  OwnOrders own; // our orders until they are done
+  OrderBudget budget; // the exchange's limits, applied before sending
+  size_t unacked;     // admitted orders not in own yet
   quantity_t volume_traded;
-  price_t last_trade_price;
-  std::string log_path;
+  BookLogger logger; // off unless started
+
+  price_t realized_pnl;
+  std::vector<TickerState*> held; // tickers with a non-zero position
 
 };
 
-class MyBot : public Bot::AbstractBot {
+class MyBot : public PacketBot {
 
 public:
 
   MyState state;
 
-  using Bot::AbstractBot::AbstractBot;
+  using PacketBot::PacketBot;
 
   static int64_t time_ns() {
 
@@ -373,48 +328,194 @@ public:
     return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
 
   }
-  int64_t last = 0, start_time;
+  int64_t start_time;
+
+  // quote off a flat 30-tick SignalEngine imbalance instead of the book's
+  // get_signal(30); quote_signal is its variant, -1 when not registered
+  bool engine_signal = false;
+  int quote_signal = -1;
 
-  bool trade_with_me_in_this_packet = false;
+  // SYNC sends from this thread, ASYNC through the gateway's sender thread
+  OrderGateway gateway;
+  OrderGateway::Mode order_mode = OrderGateway::SYNC;
+  OrderGateway::Batch requote;
+
+  // how the thread kirin.o delivers updates on (it calls init there too) and the
+  // ASYNC sender run; the receive itself is a blocking message_queue read inside
+  // kirin.o, so only the affinity and scheduling of that thread can be chosen
+  ThreadPolicy receive_policy, sender_policy;
+  int64_t last_stats_print = 0;
+  int64_t stats_interval_ns = 10000000000; // between stats prints, 0 for never
+
+  // packet start -> on_packet, and on_packet through the last on_book_changed;
+  // the order round trip is state.own.reply_latency
+  LatencyHistogram packet_latency{"packet deliver"}, strategy_latency{"strategy"};
+  int64_t strategy_entry_ns = 0;
+
+  // every update received, for replay; only when opened
+  CaptureWriter capture;
+
+  // tickers 0..quoted_tickers-1 are quoted, each starting from quote_params
+  int quoted_tickers = 1;
+  QuoteParams quote_params;
 
   // (maybe) EDIT THIS METHOD
   void init(Bot::Communicator& com) {
     state.trader_id = trader_id;
-    // state.log_path = "book.log";
+    for (int t = 0; t < quoted_tickers; t++) {
+      TickerState& ts = state.ticker(t); // also sets them up early
+      ts.quote = quote_params;
+      ts.quote.enabled = true;
+    }
+    if (engine_signal) {
+      quote_signal = state.add_signal(ImbalanceConfig{30, ImbalanceConfig::FLAT, 0.0, 10000});
+    }
     start_time = time_ns();
+    receive_policy.apply("receive");
+    gateway.start(com, order_mode, sender_policy);
   }
 
 
-  // EDIT THIS METHOD
-  void on_trade_update(Common::TradeUpdate& update, Bot::Communicator& com){
+  // (maybe) EDIT THIS METHOD
+  void on_packet(const Update* updates, size_t n, Bot::Communicator& com) {
+    // anything the exchange reacted to in this packet was sent before it,
+    // so after this every id in the packet that is ours is in state.own
+    const int64_t entry = now_ns();
+    packet_latency.record(entry - packet_start_ns);
+    strategy_entry_ns = entry;
+
+    if (capture.is_open()) {
+      capture.append_packet(packet_start_ns, updates, n);
+    }
 
-    state.on_trade_update(update);
+    gateway.drain_acks([&](const Common::Order& order, int64_t sent_ns) {
+      on_sent(order, sent_ns);
+    });
+
+    bool trade_with_me = false;
+    ticker_t traded = 0; // the ticker of our last trade in the packet
+
+    for (const Update* u = updates; u != updates + n; u++) {
+      switch (u->type) {
+        case Common::TRADE:
+          if (on_trade(u->trade)) {
+            trade_with_me = true;
+            traded = u->trade.ticker;
+          }
+          break;
+        case Common::ORDER: on_order(u->order); break;
+        case Common::CANCEL: on_cancel(u->cancel); break;
+        case Common::REJECT_ORDER: on_reject_order(u->reject_order); break;
+        case Common::REJECT_CANCEL: on_reject_cancel(u->reject_cancel); break;
+      }
+    }
+
+    if (trade_with_me) {
+
+      price_t pnl = state.get_pnl();
 
-    if (state.submitted.count(update.resting_order_id) ||
-        state.submitted.count(update.aggressing_order_id)) {
-      trade_with_me_in_this_packet = true;
+      std::cout << "got trade with me; pnl = "
+                << std::setw(15) << std::left << pnl
+                << " ; realized = "
+                << std::setw(15) << std::left << state.get_realized_pnl()
+                << " ; position = "
+                << std::setw(5) << std::left << state.position(traded)
+                << " ; pnl/s = "
+                << std::setw(15) << std::left << (pnl/((time_ns() - start_time)/1e9))
+                << " ; pnl/volume = "
+                << std::setw(15) << std::left << (state.volume_traded ? pnl/state.volume_traded : 0.0)
+                << std::endl;
+    }
+
+    if (stats_interval_ns && time_ns() - last_stats_print > stats_interval_ns) {
+      last_stats_print = time_ns();
+      gateway.print_stats(std::cout);
+      state.own.expire_pending(now_ns() - 10e9);
+      std::cout << "own orders: " << state.own.size() << " open, "
+                << state.cancels_in_flight() << " cancels in flight; "
+                << state.budget.actions_left(packet_time_ns) << " actions left; not sent: "
+                << state.budget.dropped_count(Common::RATE_LIMIT_EXCEEDED) << " rate limit, "
+                << state.budget.dropped_count(Common::OPEN_ORDERS_EXCEEDED) << " open orders, "
+                << state.budget.dropped_count(Common::POSITION_LIMIT_EXCEEDED) << " position" << std::endl;
+    }
+  }
+
+  void on_packet_done(Bot::Communicator& com) override {
+    strategy_latency.record(now_ns() - strategy_entry_ns);
+  }
+
+  void on_sent(const Common::Order& order, int64_t sent_ns) {
+    state.on_acked(order);
+    state.on_place_order(order, sent_ns);
+  }
+
+  /* SIM mode: what the exchange would answer for our orders still waiting on it
+  if every order rested untouched and every cancel went through, i.e. an ORDER
+  update for each PENDING_NEW order and a CANCEL for each PENDING_CANCEL one.
+  Benches and replay deliver these with the next packet, so that requotes find
+  resting orders to keep or cancel as they do live. Walks the per-side lists of
+  the tickers we know rather than the whole (reserved) order table.
+  */
+  void sim_replies(std::vector<Update>& out) const {
+    for (size_t i = 0; i < state.tickers.size(); i++) {
+      for (bool buy : {true, false}) {
+        for (order_id_t id : state.own.on_side(state.tickers.ticker_at(i), buy)) {
+          const OwnOrder& order = *state.own.find(id);
+          Update u;
+          if (order.status == OwnOrder::PENDING_NEW) {
+            u.type = Common::ORDER;
+            u.order = Common::OrderUpdate{order.ticker, order.price, order.quantity, id, order.buy};
+          } else if (order.status == OwnOrder::PENDING_CANCEL) {
+            u.type = Common::CANCEL;
+            u.cancel = Common::CancelUpdate{order.ticker, id};
+          } else {
+            continue;
+          }
+          out.push_back(u);
+        }
+      }
     }
+  }
+
+  // EDIT THIS METHOD; returns whether one of our orders traded
+  bool on_trade(const Common::TradeUpdate& update) {
+
+    return state.on_trade_update(update);
 
   }
 
   // EDIT THIS METHOD
-  void on_order_update(Common::OrderUpdate & update, Bot::Communicator& com){
+  void on_order(const Common::OrderUpdate& update) {
     state.on_order_update(update);
 
-    // a way to rate limit yourself
-    int64_t now = time_ns();
-    if (now - last < 10e6) { // 10ms
+    // conflated, the requote waits for the end of the packet
+    if (!conflate) {
+      maybe_quote(state.ticker(update.ticker));
+    }
+  }
+
+  void on_book_changed(ticker_t ticker, Bot::Communicator& com) override {
+    maybe_quote(state.ticker(ticker));
+  }
+
+  // only the ticker that changed is requoted, rate limited per ticker
+  void maybe_quote(TickerState& ts) {
+    if (!ts.quote.enabled || packet_time_ns - ts.last_quote_ns < ts.quote.min_interval_ns) {
       return;
     }
 
-    last = now;
+    ts.last_quote_ns = packet_time_ns;
+    quote(ts);
+  }
 
-    quantity_t bid_quote = state.books[0].quote_size(true);
-    quantity_t ask_quote = state.books[0].quote_size(false);
-    quantity_t mkt_volume = 40, bid_volume, ask_volume;
-    quantity_t position = state.positions[0];
-    price_t bid_price, ask_price, mid_price = state.books[0].get_mid_price(state.last_trade_price), spread = state.books[0].spread();
-    price_t best_bid = state.get_bbo(0, true), best_ask = state.get_bbo(0, false);
+  // EDIT THIS METHOD
+  void quote(TickerState& ts) {
+    MyBook& book = ts.book;
+    quantity_t mkt_volume = ts.quote.size, bid_volume, ask_volume;
+    quantity_t position = ts.position;
+    px_t bid_price, ask_price, spread = book.spread();
+    px_t mid_price = px_t::from_price(book.get_mid_price(ts.last_trade_price.to_price()));
+    px_t best_bid = book.get_bbo(true), best_ask = book.get_bbo(false);
 
     if (position > 0) {
       bid_volume = mkt_volume;
@@ -424,102 +525,146 @@ public:
       ask_volume = mkt_volume;
     }
 
-    double signal = state.books[0].get_signal(30);
-    if (signal > 0.2) {
-      ask_price = best_ask + (1+signal)*spread;
+    double signal = quote_signal < 0 ? book.get_signal(30) : ts.signals.imbalance(quote_signal);
+    if (signal > ts.quote.threshold) {
+      ask_price = best_ask + spread * (1+signal);
       bid_price = mid_price;
-    } else if (signal < -0.2) {
+    } else if (signal < -ts.quote.threshold) {
       ask_price = mid_price;
-      bid_price = best_bid + (1+signal)*spread;
+      bid_price = best_bid + spread * (1+signal);
     } else {
       return;
     }
 
-    for (const auto& x : state.open_orders) {      
-      place_cancel(com, Common::Cancel{
-        .ticker = 0,
-        .order_id = x.first,
-        .trader_id = trader_id
-      });
-    }
-    
-    place_order(com, Common::Order{
-        .ticker = 0,
-        .price = ask_price,
-        .quantity = ask_volume,
-        .buy = false,
-        .ioc = false,
-        .order_id = 0, // this order ID will be chosen randomly by com
-        .trader_id = trader_id
-      });
-    place_order(com, Common::Order{
-        .ticker = 0,
-        .price = bid_price,
-        .quantity = bid_volume,
-        .buy = true,
-        .ioc = false,
-        .order_id = 0, // this order ID will be chosen randomly by com
-        .trader_id = trader_id
-      });
+    // the whole requote goes to the gateway as one batch
+    requote.clear();
+    requote_side(requote, ts, false, ask_price, ask_volume);
+    requote_side(requote, ts, true, bid_price, bid_volume);
+
+    if (!requote.empty()) {
+      submit(requote);
+    }
   }
 
   // EDIT THIS METHOD
-  void on_cancel_update(Common::CancelUpdate & update, Bot::Communicator& com){
+  void on_cancel(const Common::CancelUpdate& update) {
     state.on_cancel_update(update);
   }
 
   // (maybe) EDIT THIS METHOD
-  void on_reject_order_update(Common::RejectOrderUpdate& update, Bot::Communicator& com) {
+  void on_reject_order(Common::RejectOrderUpdate update) {
+    state.on_reject_order_update(update);
     std::cout << update.getMsg() << std::endl;
   }
 
   // (maybe) EDIT THIS METHOD
-  void on_reject_cancel_update(Common::RejectCancelUpdate& update, Bot::Communicator& com) {
+  void on_reject_cancel(Common::RejectCancelUpdate update) {
+    state.on_reject_cancel_update(update);
     if (update.reason != Common::INVALID_ORDER_ID) {
       std::cout << update.getMsg() << std::endl;
     }
   }
 
-  // (maybe) EDIT THIS METHOD
-  void on_packet_start(Bot::Communicator& com) {
-    trade_with_me_in_this_packet = false;
-  }
+  // returns 0 if the exchange would reject the order, and in ASYNC mode, where
+  // the id reaches state.own at the next packet
+  order_id_t place_order(Bot::Communicator& com, const Common::Order& order) {
+    if (!state.admit_order(order, packet_time_ns)) {
+      return 0;
+    }
 
-  // (maybe) EDIT THIS METHOD
-  void on_packet_end(Bot::Communicator& com) {
-    if (trade_with_me_in_this_packet) {
+    Common::Order copy = order;
 
-      price_t pnl = state.get_pnl();
+    copy.order_id = gateway.place_order(order);
 
-      std::cout << "got trade with me; pnl = "
-                << std::setw(15) << std::left << pnl
-                << " ; position = "
-                << std::setw(5) << std::left << state.positions[0]
-                << " ; pnl/s = "
-                << std::setw(15) << std::left << (pnl/((time_ns() - start_time)/1e9))
-                << " ; pnl/volume = "
-                << std::setw(15) << std::left << (state.volume_traded ? pnl/state.volume_traded : 0.0)
-                << std::endl;
+    if (copy.order_id) {
+      on_sent(copy, now_ns());
     }
+
+    return copy.order_id;
   }
 
-  order_id_t place_order(Bot::Communicator& com, const Common::Order& order) {
-    Common::Order copy = order;
+  // sends nothing for an order that is already being cancelled, or if the
+  // exchange would reject the cancel
+  void place_cancel(Bot::Communicator& com, const Common::Cancel& cancel) {
+    if (state.on_place_cancel(cancel, packet_time_ns)) {
+      gateway.place_cancel(cancel);
+    }
+  }
+
+  /* Adds to `batch` what it takes to leave exactly one of our orders resting on
+  this side at `price` for at most `quantity`.
+  The exchange has no modify message, so an open order that already rests at
+  that price with no more than `quantity` left is kept as it is: it keeps its
+  queue priority and costs no messages. Every other open order on the side is
+  cancelled, and a new order is added only if nothing was kept.
+  An order sent but not acked yet (PENDING_NEW) counts as kept the same way, so
+  requoting faster than the acks come back does not stack a new full-size order
+  on the side each time; one at another price cannot be cancelled before its
+  ack and is left alone. Nor is anything added while the side still has an
+  order admitted but not handed to the exchange (ASYNC mode).
+  An order whose cancel is still in flight is already on its way out: it is
+  neither kept nor cancelled again, since a second cancel can only come back as
+  a REJECT_CANCEL and costs rate limit. Nothing the exchange would reject (see
+  OrderBudget) is added, and nothing at a price of zero or below.
+  */
+  void requote_side(OrderGateway::Batch& batch, const TickerState& ts, bool buy, px_t price, quantity_t quantity) {
+    const ticker_t ticker = ts.ticker;
+    bool kept = false;
+
+    for (order_id_t id : state.own.on_side(ticker, buy)) {
+      const OwnOrder& order = *state.own.find(id);
+      if (!kept && (order.resting() || order.status == OwnOrder::PENDING_NEW) &&
+          px_t::from_price(order.price) == price && order.quantity <= quantity) {
+        kept = true;
+        continue;
+      }
 
-    copy.order_id = com.place_order(order);
+      if (!order.resting()) {
+        continue;
+      }
 
-    state.on_place_order(copy);
+      const Common::Cancel cancel{
+        .ticker = ticker,
+        .order_id = id,
+        .trader_id = trader_id
+      };
+      // only changes the order's status, so safe mid-loop
+      if (state.on_place_cancel(cancel, packet_time_ns)) {
+        batch.cancel(cancel);
+      }
+    }
 
-    return copy.order_id;
+    // a side that is empty leaves nothing sensible to price from
+    if (kept || ts.unacked_qty[buy] > 0 || price.ticks <= 0) {
+      return;
+    }
+
+    const Common::Order order{
+      .ticker = ticker,
+      .price = price.to_price(),
+      .quantity = quantity,
+      .buy = buy,
+      .ioc = false,
+      .order_id = 0, // this order ID will be chosen randomly by com
+      .trader_id = trader_id
+    };
+    if (state.admit_order(order, packet_time_ns)) {
+      batch.order(order);
+    }
   }
 
-  void place_cancel(Bot::Communicator& com, const Common::Cancel& cancel) {
-    com.place_cancel(cancel);
+  void submit(OrderGateway::Batch& batch) {
+    gateway.submit(batch, [&](const Common::Order& order, int64_t sent_ns) {
+      on_sent(order, sent_ns);
+    });
   }
 
 };
 
 
+// replay.cpp includes this file for MyBot and brings its own main
+#ifndef COMPETITOR_NO_MAIN
+
 int main(int argc, const char ** argv) {
 
 
@@ -529,6 +674,56 @@ int main(int argc, const char ** argv) {
 
   assert(m != NULL);
 
+  // ./mybot [tickers=N] [conflate] [imbalance] [async] [latency] [capture] [booklog] [pin=R,S] [fifo] [busy] [mlock]
+  //   tickers=N: quote tickers 0..N-1 (the exchange lists 10); 1 by default
+  //   conflate: requote once per changed ticker at the end of each packet, with
+  //     no time throttle, instead of on ORDER updates at most every 10ms
+  //   imbalance: quote off an incremental flat 30-tick imbalance (levels capped
+  //     at 10000) instead of walking 30 orders with get_signal(30)
+  //   async: send orders from a dedicated thread instead of the callback
+  //   latency: print the per-stage latency histograms when the bot exits
+  //   capture: record every update to capture.bin, see ./replay
+  //   booklog: log book updates and periodic snapshots to book.log
+  //   pin=R,S: pin the receive/strategy thread to CPU R and the sender to CPU S
+  //   fifo: run both SCHED_FIFO
+  //   busy: the sender busy-polls instead of yielding; only with a CPU of its own
+  //   mlock: lock all memory before trading starts
+  for (int i = 1; i < argc; i++) {
+    int receive_cpu, sender_cpu, tickers;
+    if (sscanf(argv[i], "tickers=%d", &tickers) == 1 && tickers >= 1 && tickers <= MAX_NUM_TICKERS) {
+      m->quoted_tickers = tickers;
+    } else if (std::string(argv[i]) == "imbalance") {
+      m->engine_signal = true;
+    } else if (std::string(argv[i]) == "conflate") {
+      m->conflate = true;
+      m->quote_params.min_interval_ns = 0;
+    } else if (sscanf(argv[i], "pin=%d,%d", &receive_cpu, &sender_cpu) == 2) {
+      m->receive_policy.cpu = receive_cpu;
+      m->sender_policy.cpu = sender_cpu;
+    } else if (std::string(argv[i]) == "fifo") {
+      m->receive_policy.fifo_priority = 50;
+      m->sender_policy.fifo_priority = 50;
+    } else if (std::string(argv[i]) == "busy") {
+      m->sender_policy.spin_limit = SpinWait::BUSY_POLL;
+    } else if (std::string(argv[i]) == "mlock") {
+      if (!lock_memory()) {
+        return 1;
+      }
+    } else if (std::string(argv[i]) == "async") {
+      m->order_mode = OrderGateway::ASYNC;
+    } else if (std::string(argv[i]) == "latency") {
+      dump_latencies_at_exit();
+    } else if (std::string(argv[i]) == "booklog") {
+      if (!m->state.logger.start("book.log")) {
+        return 1;
+      }
+    } else if (std::string(argv[i]) == "capture") {
+      if (!m->capture.open("capture.bin")) {
+        return 1;
+      }
+    }
+  }
+
   Manager::Manager manager;
 
   std::vector<Bot::AbstractBot*> bots {m};
@@ -536,3 +731,5 @@ int main(int argc, const char ** argv) {
 
   return 0;
 }
+
+#endif
@@ -1,4 +1,5 @@
 #include "kirin.hpp"
+#include "level_book.hpp"
 #include <cassert>
 #include <iostream>
 #include <iomanip>
@@ -12,247 +13,7 @@
 #include <cstdlib>
 
 
-struct LimitOrder {
-  price_t price;
-  mutable quantity_t quantity; // mutable so set doesn't complain
-  order_id_t order_id;
-  long long time;
-  trader_id_t trader_id;
-  bool buy;
-
-  bool operator <(const LimitOrder& other) const {
-    // < means more aggressive
-    if (buy) {
-      return price > other.price || (price == other.price && time < other.time);
-    } else {
-      return price < other.price || (price == other.price && time < other.time);
-    }
-  }
-
-  bool trades_with(const LimitOrder& other) const {
-    return ((buy && !other.buy && price >= other.price) ||
-            (!buy && other.buy && price <= other.price));
-  }
-};
-
-
-struct MyBook {
-public:
-
-  MyBook() {}
-
-  price_t get_bbo(bool buy) const {
-    const std::set<LimitOrder>& side = sides[buy];
-
-    if (side.empty()) {
-      return 0.0;
-    }
-    return side.begin()->price;
-  }
-
-  price_t get_mid_price(price_t default_to) const {
-    price_t best_bid = get_bbo(true);
-    price_t best_offer = get_bbo(false);
-
-    if (best_bid == 0.0 || best_offer == 0.0) {
-      return default_to;
-    }
-
-    return 0.5 * (best_bid + best_offer);
-
-  }
-
-  /* ---USE THIS FUNCTION TO GENERATE A SIGNAL---
-  Currently, I calculate bid and ask volume for all levels.
-  I then calculate (bid_vol - ask_vol)/(bid_vol + ask_vol)
-  */
-  double get_signal(int num_levels) const {
-    bool bid = true, ask = false;
-    price_t best_bid = get_bbo(bid);
-    price_t best_offer = get_bbo(ask);
-
-    double signal = 0.0;
-
-    if (best_bid == 0.0 || best_offer == 0.0) {
-      return signal; // no signal can be found in this case
-    }
-
-    // Calculate bid volume for all levels
-    /*
-    quantity_t bid_volume = 0;
-    for (auto& x : sides[bid]) {
-      if (x.price > best_bid) {
-        break;
-      }
-      bid_volume += x.quantity;
-    }
-    */
-
-    // Calculate  ask volume for all levels
-    /*
-    quantity_t ask_volume = 0;
-    for (auto& x : sides[ask]) {
-      if (x.price < best_offer) {
-        break;
-      }
-      ask_volume += x.quantity;
-    }
-    */
-
-    double weight;
-    // Calculate bid volume for up to n levels
-    quantity_t bid_volume = 0;
-    std::set<LimitOrder>::iterator bid_level=sides[1].begin();
-    for (int i = 0; i<num_levels && bid_level!=sides[1].end(); i++) {
-      weight = 1 - abs(best_bid - bid_level->price)/best_bid;
-      bid_volume += weight * (bid_level->quantity);
-      bid_level++;
-    }
-
-    // Calculate ask volume for up to n levels
-    quantity_t ask_volume = 0;
-    std::set<LimitOrder>::iterator ask_level=sides[0].begin();
-    for (int i = 0; i<num_levels && ask_level!=sides[0].end(); i++) {
-      weight = 1 - abs(ask_level->price - best_offer)/best_offer;
-      ask_volume += weight * (ask_level->quantity);
-      ask_level++;
-    }
-      
-
-    // Calculate signal
-    signal = ((double)bid_volume - (double)ask_volume)/((double)bid_volume + (double)ask_volume);
-
-    return signal;
-  }
-
-  int num_levels(bool buy) {
-    int count = 0;
-    for (std::set<LimitOrder>::iterator level = sides[buy].begin(); level!=sides[buy].end(); level++)
-      count+=1;
-
-    return count;
-  }
-
-  void insert(Common::Order order_to_insert) {
-
-    LimitOrder order_left = {
-      .price = order_to_insert.price,
-      .quantity = order_to_insert.quantity,
-      .order_id = order_to_insert.order_id,
-      .time = std::chrono::steady_clock::now().time_since_epoch().count(),
-      .trader_id = order_to_insert.trader_id,
-      .buy = order_to_insert.buy
-    };
-
-    auto& side = sides[(size_t)order_left.buy];
-
-    auto it_new = side.insert(order_left);
-    assert(it_new.second);
-    order_map[order_left.order_id] = it_new.first;
-
-  }
-
-  void cancel(trader_id_t trader_id, order_id_t order_id) {
-
-
-    if (!order_map.count(order_id)) {
-      std::cout << "order " << order_id << " nonexistent" << std::endl;
-      return;
-    }
-    auto it = order_map[order_id];
-
-    order_map.erase(order_id);
-
-    auto& side = sides[(size_t)it->buy];
-    side.erase(it);
-  }
-
-  quantity_t decrease_qty(order_id_t order_id, quantity_t decrease_by) {
-
-    if (!order_map.count(order_id)) {
-      return -1;
-    }
-
-    std::set<LimitOrder>::iterator it = order_map[order_id];
-
-    if (decrease_by >= it->quantity) {
-      order_map.erase(order_id);
-      std::set<LimitOrder>& side = sides[(size_t)it->buy];
-      side.erase(it);
-      return 0;
-
-    } else {
-
-      it->quantity -= decrease_by;
-      return it->quantity;
-    }
-
-  }
-
-  void print_book(std::string fp, const std::unordered_map<order_id_t, Common::Order>& mine={}) {
-    if (fp == "") {
-      return;
-    }
-
-    std::ofstream fout(fp);
-
-    fout << "offers\n";
-    for (auto rit = sides[0].rbegin(); rit != sides[0].rend(); rit++) {
-      auto x = *rit;
-      fout << x.price << ' ' << x.quantity;
-      if (mine.count(x.order_id)) {
-        fout << " (mine)";
-      }
-      fout << '\n';
-    }
-
-    fout << "\nbids\n";
-
-    for (auto& x : sides[1]) {
-      fout << x.price << ' ' << x.quantity;
-      if (mine.count(x.order_id)) {
-        fout << " (mine)";
-      }
-      fout << '\n';
-    }
-
-    fout << "EOF" << std::endl;
-
-
-    fout.close();
-  }
-
-  quantity_t quote_size(bool buy) {
-    price_t p = get_bbo(buy);
-    if (p == 0.0) {
-      return 0;
-    }
-
-    quantity_t ans = 0;
-    for (auto& x : sides[buy]) {
-      if (x.price != p) {
-        break;
-      }
-      ans += x.quantity;
-    }
-    return ans;
-  }
-  price_t spread() {
-
-    price_t best_bid = get_bbo(true);
-    price_t best_offer = get_bbo(false);
-
-    if (best_bid == 0.0 || best_offer == 0.0) {
-      return 0.0;
-    }
-
-    return best_offer - best_bid;
-  }
-
-private:
-  std::set<LimitOrder> sides[2];
-  std::unordered_map<order_id_t, std::set<LimitOrder>::iterator> order_map;
-};
+typedef LevelBook MyBook;
 
 
 struct MyState {
@@ -353,11 +114,11 @@ struct MyState {
   }
 
   price_t get_bbo(ticker_t ticker, bool buy) {
-    return books[ticker].get_bbo(buy);
+    return books[ticker].get_bbo(buy).to_price();
   }
 
   double get_signal(ticker_t ticker, int num_levels) {
-    return books[ticker].get_signal(num_levels);
+    return books[ticker].get_signal(num_levels, NO_QTY_LIMIT);
   }
 
   price_t get_mid_price(ticker_t ticker) {
@@ -365,7 +126,7 @@ struct MyState {
   }
 
   price_t get_spread(ticker_t ticker) {
-    return books[ticker].spread();
+    return books[ticker].spread().to_price();
   }
 
   trader_id_t trader_id;
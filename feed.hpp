@@ -0,0 +1,135 @@
+#pragma once
+
+#include "kirin.hpp"
+#include "price.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+/*
+Synthetic order flow for the benchmarks: a reproducible stream of inserts,
+cancels and trades against resting orders, and apply() to feed it to any book
+with the MyBook interface.
+*/
+
+
+struct FeedEvent {
+  Common::UpdateType type;
+  price_t price;
+  quantity_t quantity;
+  order_id_t order_id;
+  bool buy;
+};
+
+
+// Random walk around 100.00 with most of the flow near the touch, roughly
+// 60% new orders, 30% cancels and 10% trades against the touch. New orders turn
+// into cancels once MAX_LIVE orders rest, so the book settles at a steady depth.
+const size_t MAX_LIVE = 4000;
+
+inline std::vector<FeedEvent> make_feed(size_t n, uint64_t seed) {
+  std::mt19937_64 rng(seed);
+  std::vector<FeedEvent> feed;
+  feed.reserve(n);
+
+  // resting orders per side, tick -> FIFO of (order_id, quantity)
+  std::map<tick_t, std::deque<std::pair<order_id_t, quantity_t>>> sides[2];
+  std::vector<std::pair<order_id_t, bool>> live;
+  std::unordered_map<order_id_t, std::pair<tick_t, size_t>> where; // id -> (tick, index in live)
+
+  tick_t mid = 10000;
+  order_id_t next_id = 1;
+
+  auto forget = [&](order_id_t id) {
+    size_t i = where[id].second;
+    live[i] = live.back();
+    where[live[i].first].second = i;
+    live.pop_back();
+    where.erase(id);
+  };
+
+  while (feed.size() < n) {
+    uint64_t r = rng() % 100;
+
+    if (rng() % 50 == 0) {
+      mid += (rng() % 2) ? 1 : -1;
+    }
+
+    if ((r < 60 && live.size() < MAX_LIVE) || live.size() < 200) {
+      bool buy = rng() % 2;
+      tick_t offset = 1 + std::min<tick_t>(rng() % 64, rng() % 64);
+      tick_t tick = buy ? mid - offset : mid + offset;
+      quantity_t qty = (rng() % 20 == 0) ? 1000 + rng() % 20000 : 1 + rng() % 200;
+      order_id_t id = next_id++;
+
+      sides[buy][tick].push_back({id, qty});
+      where[id] = {tick, live.size()};
+      live.push_back({id, buy});
+      feed.push_back(FeedEvent{Common::ORDER, px_t::from_ticks(tick).to_price(), qty, id, buy});
+
+    } else if (r < 90 || live.size() >= MAX_LIVE) {
+      auto victim = live[rng() % live.size()];
+      auto& level = sides[victim.second][where[victim.first].first];
+      level.erase(std::find_if(level.begin(), level.end(),
+                               [&](const std::pair<order_id_t, quantity_t>& o) { return o.first == victim.first; }));
+      if (level.empty()) {
+        sides[victim.second].erase(where[victim.first].first);
+      }
+      forget(victim.first);
+      feed.push_back(FeedEvent{Common::CANCEL, 0.0, 0, victim.first, victim.second});
+
+    } else {
+      bool resting_buy = rng() % 2;
+      auto& side = sides[resting_buy];
+      if (side.empty()) {
+        continue;
+      }
+      auto level_it = resting_buy ? std::prev(side.end()) : side.begin();
+      auto& front = level_it->second.front();
+      quantity_t qty = std::min<quantity_t>(front.second, 1 + rng() % 300);
+
+      feed.push_back(FeedEvent{Common::TRADE, px_t::from_ticks(level_it->first).to_price(), qty, front.first, !resting_buy});
+
+      front.second -= qty;
+      if (front.second == 0) {
+        forget(front.first);
+        level_it->second.pop_front();
+        if (level_it->second.empty()) {
+          side.erase(level_it);
+        }
+      }
+    }
+  }
+
+  return feed;
+}
+
+
+template <typename Book>
+void apply(Book& book, const FeedEvent& e) {
+  switch (e.type) {
+    case Common::ORDER:
+      book.insert(Common::Order{
+        .ticker = 0,
+        .price = e.price,
+        .quantity = e.quantity,
+        .buy = e.buy,
+        .ioc = false,
+        .order_id = e.order_id,
+        .trader_id = 0
+      });
+      break;
+    case Common::CANCEL:
+      book.cancel(0, e.order_id);
+      break;
+    case Common::TRADE:
+      book.decrease_qty(e.order_id, e.quantity);
+      break;
+    default:
+      break;
+  }
+}
@@ -1,3 +1,5 @@
+#pragma once
+
 #include <cstdint>
 #include <random>
 #include <string>
@@ -208,6 +210,9 @@ namespace Manager {
   public:
     void register_bot_client( std::string & prefix, trader_id_t trader);
     void run_competitors(std::string & prefix, std::vector<Bot::AbstractBot*>& bots);
+    // the exchange side: runs the exchange and its own bots on the queues named
+    // after prefix, for num_bots competitor bots to connect to
+    void run_kirin(std::string & prefix, int num_bots);
     static trader_id_t get_random_trader_id();
   private:
 
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+
+static inline int64_t now_ns() {
+  using namespace std::chrono;
+  return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+
+/*
+Log-linear latency histogram in the style of HdrHistogram: values below
+2*SUB nanoseconds get a bucket each, above that every power of two is split into
+SUB equal buckets, so any value is off by at most 1/SUB (about 3%). Recording is
+a bit scan and one counter bump, with no allocation; values past MAX_NS land in
+the last bucket.
+
+One thread records; any thread may read, at the cost of a slightly stale view.
+Every histogram registers itself under its name so dump_latencies() can print
+them all, e.g. at shutdown.
+*/
+class LatencyHistogram {
+public:
+  static const int SUB_BITS = 5;
+  static const int64_t SUB = 1 << SUB_BITS;
+  static const int64_t MAX_NS = (int64_t)1 << 40; // about 18 minutes
+  static const int NUM_BUCKETS = (40 - SUB_BITS + 1) * SUB;
+
+  explicit LatencyHistogram(const char* name) : name(name) {
+    for (auto& c : counts) {
+      c.store(0, std::memory_order_relaxed);
+    }
+    std::lock_guard<std::mutex> lock(registry_mutex());
+    registry().push_back(this);
+  }
+
+  ~LatencyHistogram() {
+    std::lock_guard<std::mutex> lock(registry_mutex());
+    auto& all = registry();
+    all.erase(std::remove(all.begin(), all.end(), this), all.end());
+  }
+
+  LatencyHistogram(const LatencyHistogram&) = delete;
+  LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+  void record(int64_t ns) {
+    ns = std::max<int64_t>(0, std::min(ns, MAX_NS - 1));
+    bump(counts[bucket(ns)], 1);
+    bump(total, 1);
+    bump(sum_ns, ns);
+    if (ns > max_ns.load(std::memory_order_relaxed)) {
+      max_ns.store(ns, std::memory_order_relaxed);
+    }
+  }
+
+  int64_t count() const {
+    return total.load(std::memory_order_relaxed);
+  }
+
+  int64_t mean() const {
+    int64_t n = count();
+    return n ? sum_ns.load(std::memory_order_relaxed) / n : 0;
+  }
+
+  int64_t max() const {
+    return max_ns.load(std::memory_order_relaxed);
+  }
+
+  // upper edge of the bucket holding the p-th fraction of values, p in [0, 1]
+  int64_t percentile(double p) const {
+    int64_t n = count();
+    if (n == 0) {
+      return 0;
+    }
+    int64_t rank = std::max<int64_t>(1, (int64_t)(p * n + 0.5));
+    int64_t seen = 0;
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+      seen += counts[i].load(std::memory_order_relaxed);
+      if (seen >= rank) {
+        return std::min(upper_edge(i), max());
+      }
+    }
+    return max();
+  }
+
+  void print(std::ostream& os) const {
+    os << std::setw(16) << std::left << name
+       << " n " << std::setw(9) << count()
+       << " mean " << std::setw(9) << mean()
+       << " p50 " << std::setw(9) << percentile(0.50)
+       << " p99 " << std::setw(9) << percentile(0.99)
+       << " p99.9 " << std::setw(9) << percentile(0.999)
+       << " max " << max() << "  (ns)" << std::endl;
+  }
+
+  // adds another histogram's values to this one; exact once `other` has stopped
+  // recording, slightly stale otherwise
+  void merge(const LatencyHistogram& other) {
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+      bump(counts[i], other.counts[i].load(std::memory_order_relaxed));
+    }
+    bump(total, other.count());
+    bump(sum_ns, other.sum_ns.load(std::memory_order_relaxed));
+    if (other.max() > max()) {
+      max_ns.store(other.max(), std::memory_order_relaxed);
+    }
+  }
+
+  void reset() {
+    for (auto& c : counts) {
+      c.store(0, std::memory_order_relaxed);
+    }
+    total.store(0, std::memory_order_relaxed);
+    sum_ns.store(0, std::memory_order_relaxed);
+    max_ns.store(0, std::memory_order_relaxed);
+  }
+
+  const char* const name;
+
+private:
+  friend void dump_latencies(std::ostream& os);
+
+  static int bucket(int64_t ns) {
+    if (ns < 2 * SUB) {
+      return ns;
+    }
+    int shift = 63 - __builtin_clzll(ns) - SUB_BITS;
+    return shift * SUB + (ns >> shift);
+  }
+
+  static int64_t upper_edge(int i) {
+    if (i < 2 * SUB) {
+      return i;
+    }
+    int shift = i / SUB - 1;
+    int64_t mantissa = i - shift * SUB;
+    return ((mantissa + 1) << shift) - 1;
+  }
+
+  // single writer, so no read-modify-write is needed
+  static void bump(std::atomic<int64_t>& x, int64_t by) {
+    x.store(x.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+  }
+
+  static std::vector<LatencyHistogram*>& registry() {
+    static std::vector<LatencyHistogram*> all;
+    return all;
+  }
+
+  static std::mutex& registry_mutex() {
+    static std::mutex mu;
+    return mu;
+  }
+
+  std::atomic<int64_t> counts[NUM_BUCKETS];
+  std::atomic<int64_t> total{0}, sum_ns{0}, max_ns{0};
+};
+
+
+// prints every live histogram that has recorded anything
+inline void dump_latencies(std::ostream& os = std::cout) {
+  std::lock_guard<std::mutex> lock(LatencyHistogram::registry_mutex());
+  os << "latency by stage:" << std::endl;
+  for (const LatencyHistogram* h : LatencyHistogram::registry()) {
+    if (h->count()) {
+      h->print(os);
+    }
+  }
+}
+
+
+/*
+Dumps the histograms when the process ends, whether main returns, exit() is
+called or it is stopped with SIGINT/SIGTERM (the bots normally run until they
+are killed). The signal handler turns the signal into exit(), which is not
+async-signal-safe but is what makes the atexit dump run; this is a debugging
+aid, not something to leave on in production.
+*/
+inline void dump_latencies_at_exit() {
+  static std::once_flag once;
+  std::call_once(once, [] {
+    std::atexit([] { dump_latencies(std::cout); });
+    auto on_signal = [](int sig) {
+      std::signal(sig, SIG_DFL);
+      std::exit(128 + sig);
+    };
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+  });
+}
@@ -0,0 +1,585 @@
+#pragma once
+
+#include "kirin.hpp"
+#include "order_id_map.hpp"
+#include "price.hpp"
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <fstream>
+
+#include <algorithm>
+#include <vector>
+
+
+const quantity_t NO_QTY_LIMIT = INT64_MAX;
+
+struct LevelBook;
+
+// Told about every change to a book's level quantities, after the book has
+// applied it. Used to keep derived state such as signals in step with the book.
+struct LevelListener {
+  // the quantity resting at `tick` changed by `delta`; the touch did not move
+  virtual void on_level_change(const LevelBook& book, bool buy, tick_t tick, quantity_t delta) = 0;
+  // the touch on this side moved (or the side emptied)
+  virtual void on_touch_change(const LevelBook& book, bool buy) = 0;
+};
+
+
+/*
+Price-level book keyed on integer ticks.
+
+Each side is a contiguous array of levels indexed by (tick - base). A level keeps
+its aggregate size and order count next to the head/tail of an intrusive FIFO of
+the orders resting there, so the touch is a single array read. Orders live in a
+pool and are recycled through a free list, and order ids map to pool slots
+through a flat OrderIdMap, so in steady state insert, cancel and decrease_qty
+never touch the allocator.
+
+The level array only grows (re-centering around the new price) when an order
+arrives outside the current window.
+
+Side totals (volume, order and level counts) and the depth over the first
+depth_levels non-empty levels are kept up to date by insert, cancel and
+decrease_qty, so every query below except get_signal is a constant-time read.
+The depth levels are counted as levels, not ticks, so a sparse book reaches
+further out for them. Their ticks are kept in a short array: a quantity change
+at one of them is an add, a level appearing among them is a shift, and only a
+level emptying there looks past the last one for its replacement. The whole
+list is rebuilt only when the touch moves.
+*/
+struct LevelBook {
+public:
+
+  LevelBook() :
+    best{0, 0}, base{0, 0}, order_count{0, 0}, level_count{0, 0}, volume{0, 0},
+    depth_levels(10), depth_size{0, 0}, depth_qty{0, 0}, depth_weighted{0, 0}, free_head(NIL),
+    listener(NULL) {}
+
+  px_t get_bbo(bool buy) const {
+    if (order_count[buy] == 0) {
+      return NO_PRICE;
+    }
+    return px_t::from_ticks(best[buy]);
+  }
+
+  // price of the next non-empty level behind the touch
+  px_t get_2nd_bbo(bool buy) const {
+    if (order_count[buy] == 0) {
+      return NO_PRICE;
+    }
+
+    tick_t tick;
+    if (!next_level(buy, best[buy], tick)) {
+      return NO_PRICE;
+    }
+    return px_t::from_ticks(tick);
+  }
+
+  /* ---USE THIS FUNCTION TO GENERATE A SIGNAL---
+  Same computation as SetBook::get_signal: walks the first num_levels orders
+  (best price first, FIFO within a price) on each side, skipping orders above
+  max_order_qty shares, and returns (bid_vol - ask_vol)/(bid_vol + ask_vol).
+  */
+  double get_signal(int num_levels, quantity_t max_order_qty = 10000) const {
+    bool bid = true, ask = false;
+    if (order_count[bid] == 0 || order_count[ask] == 0) {
+      return 0.0; // no signal can be found in this case
+    }
+
+    price_t best_bid = get_bbo(bid).to_price();
+    price_t best_offer = get_bbo(ask).to_price();
+
+    double signal = 0.0;
+
+    double weight;
+    int i;
+
+    // Calculate bid volume for up to n orders
+    quantity_t bid_volume = 0;
+    i = 0;
+    for_each_order(bid, [&](const Node& order) {
+      if (i++ >= num_levels) {
+        return false;
+      }
+      if (order.quantity > max_order_qty) {
+        return true;
+      }
+      weight = 1 - abs(best_bid - px_t::from_ticks(order.tick).to_price())/best_bid;
+      bid_volume += weight * (order.quantity);
+      return true;
+    });
+
+    // Calculate ask volume for up to n orders
+    quantity_t ask_volume = 0;
+    i = 0;
+    for_each_order(ask, [&](const Node& order) {
+      if (i++ >= num_levels) {
+        return false;
+      }
+      if (order.quantity > max_order_qty) {
+        return true;
+      }
+      weight = 1 - abs(px_t::from_ticks(order.tick).to_price() - best_offer)/best_offer;
+      ask_volume += weight * (order.quantity);
+      return true;
+    });
+
+    // Calculate signal
+    signal = ((double)bid_volume - (double)ask_volume)/((double)bid_volume + (double)ask_volume);
+
+    return signal;
+  }
+
+  // the mid can sit between two ticks, so it is returned as a plain price
+  price_t get_mid_price(price_t default_to) const {
+    if (order_count[true] == 0 || order_count[false] == 0) {
+      return default_to;
+    }
+
+    return (best[true] + best[false]) / (2.0 * px_t::ticks_per_unit);
+  }
+
+
+  void insert(Common::Order order_to_insert) {
+    insert(px_t::from_price(order_to_insert.price), order_to_insert.quantity,
+           order_to_insert.order_id, order_to_insert.buy);
+  }
+
+  void insert(px_t price, quantity_t quantity, order_id_t order_id, bool buy) {
+    const tick_t tick = price.ticks;
+
+    Level* level = reserve_level(buy, tick);
+    if (level == NULL) {
+      std::cout << "order " << order_id << " price " << price << " out of book range" << std::endl;
+      return;
+    }
+
+    // the map first: a duplicate id must not reach the level
+    uint32_t idx = alloc_node();
+    if (!order_map.emplace(order_id, idx)) {
+      free_node(idx);
+      std::cout << "order " << order_id << " already in the book" << std::endl;
+      return;
+    }
+
+    Node& order = nodes[idx];
+    order.order_id = order_id;
+    order.quantity = quantity;
+    order.tick = tick;
+    order.prev = level->tail;
+    order.next = NIL;
+    order.buy = buy;
+
+    if (level->tail != NIL) {
+      nodes[level->tail].next = idx;
+    } else {
+      level->head = idx;
+    }
+    level->tail = idx;
+    level->quantity += quantity;
+    if (level->count++ == 0) {
+      level_count[buy]++;
+    }
+    volume[buy] += quantity;
+
+    if (order_count[buy]++ == 0 || more_aggressive(buy, tick, best[buy])) {
+      best[buy] = tick;
+      touch_moved(buy);
+    } else {
+      level_changed(buy, tick, quantity);
+    }
+  }
+
+  void cancel(trader_id_t trader_id, order_id_t order_id) {
+    const uint32_t* it = order_map.find(order_id);
+    if (!it) {
+      std::cout << "order " << order_id << " nonexistent" << std::endl;
+      return;
+    }
+
+    uint32_t idx = *it;
+    order_map.erase(order_id);
+    remove(idx);
+  }
+
+  quantity_t decrease_qty(order_id_t order_id, quantity_t decrease_by) {
+    const uint32_t* it = order_map.find(order_id);
+    if (!it) {
+      return -1;
+    }
+
+    uint32_t idx = *it;
+    Node& order = nodes[idx];
+
+    if (decrease_by >= order.quantity) {
+      order_map.erase(order_id);
+      remove(idx);
+      return 0;
+    }
+
+    order.quantity -= decrease_by;
+    level_of(order).quantity -= decrease_by;
+    volume[order.buy] -= decrease_by;
+    level_changed(order.buy, order.tick, -decrease_by);
+    return order.quantity;
+  }
+
+  // `mine` is any map keyed on order id (std::unordered_map, OrderIdMap)
+  template <typename Orders = OrderIdMap<Common::Order>>
+  void print_book(std::string fp, const Orders& mine = Orders(16)) {
+    if (fp == "") {
+      return;
+    }
+
+    std::ofstream fout(fp, std::fstream::app);
+
+    // offers from the highest price down, bids from the highest price down
+    fout << "offers\n";
+    for (size_t i = levels[0].size(); i-- > 0; ) {
+      for (uint32_t idx = levels[0][i].tail; idx != NIL; idx = nodes[idx].prev) {
+        print_order(fout, nodes[idx], mine);
+      }
+    }
+
+    fout << "\nbids\n";
+
+    for (size_t i = levels[1].size(); i-- > 0; ) {
+      for (uint32_t idx = levels[1][i].head; idx != NIL; idx = nodes[idx].next) {
+        print_order(fout, nodes[idx], mine);
+      }
+    }
+
+    fout << "EOF" << std::endl;
+
+    fout.close();
+  }
+
+  quantity_t quote_size(bool buy) const {
+    if (order_count[buy] == 0) {
+      return 0;
+    }
+    return levels[buy][best[buy] - base[buy]].quantity;
+  }
+
+  // total resting quantity on one side
+  quantity_t get_quote_vol(bool buy) const {
+    return volume[buy];
+  }
+
+  // number of non-empty price levels on one side
+  int num_levels(bool buy) const {
+    return level_count[buy];
+  }
+
+  int64_t num_orders(bool buy) const {
+    return order_count[buy];
+  }
+
+  // resting quantity in the first depth_levels non-empty levels, touch included
+  quantity_t depth(bool buy) const {
+    return depth_qty[buy];
+  }
+
+  // the same levels, the one at rank r from the touch weighted by 1 - r/depth_levels
+  double weighted_depth(bool buy) const {
+    return depth_weighted[buy] / (double)depth_levels;
+  }
+
+  // quantity resting at one price, 0 for an empty or unknown level
+  quantity_t level_qty(bool buy, tick_t tick) const {
+    tick_t t = tick - base[buy];
+    if (t < 0 || t >= (tick_t)levels[buy].size()) {
+      return 0;
+    }
+    return levels[buy][t].quantity;
+  }
+
+  // visits non-empty levels from the touch outwards as f(tick, quantity, count),
+  // until f returns false
+  template <typename F>
+  void for_each_level(bool buy, F f) const {
+    if (order_count[buy] == 0) {
+      return;
+    }
+
+    const std::vector<Level>& side = levels[buy];
+    const tick_t step = buy ? -1 : 1;
+
+    for (tick_t t = best[buy] - base[buy]; t >= 0 && t < (tick_t)side.size(); t += step) {
+      if (side[t].count && !f(t + base[buy], side[t].quantity, side[t].count)) {
+        return;
+      }
+    }
+  }
+
+  // at most one listener; it must outlive the book or be reset to NULL
+  void set_listener(LevelListener* l) {
+    listener = l;
+  }
+
+  void set_depth_levels(int n) {
+    assert(n > 0 && n <= MAX_DEPTH_LEVELS);
+    depth_levels = n;
+    refresh_depth(true);
+    refresh_depth(false);
+  }
+
+  px_t spread() const {
+    if (order_count[true] == 0 || order_count[false] == 0) {
+      return NO_PRICE;
+    }
+
+    return px_t::from_ticks(best[false] - best[true]);
+  }
+
+private:
+  static const uint32_t NIL = UINT32_MAX;
+  static const size_t INITIAL_LEVELS = 1 << 10;
+  static const size_t MAX_LEVELS = 1 << 20;
+  static const int MAX_DEPTH_LEVELS = 32;
+
+  struct Level {
+    quantity_t quantity;
+    uint32_t count;
+    uint32_t head; // oldest order at this price
+    uint32_t tail; // newest order at this price
+  };
+
+  struct Node {
+    order_id_t order_id;
+    quantity_t quantity;
+    tick_t tick;
+    uint32_t prev;
+    uint32_t next; // doubles as the free list link
+    bool buy;
+  };
+
+  static bool more_aggressive(bool buy, tick_t a, tick_t b) {
+    return buy ? a > b : a < b;
+  }
+
+  Level& level_of(const Node& order) {
+    return levels[order.buy][order.tick - base[order.buy]];
+  }
+
+  // finds the first non-empty level strictly behind `from`
+  bool next_level(bool buy, tick_t from, tick_t& out) const {
+    const std::vector<Level>& side = levels[buy];
+    const tick_t step = buy ? -1 : 1;
+
+    for (tick_t t = from + step - base[buy]; t >= 0 && t < (tick_t)side.size(); t += step) {
+      if (side[t].count) {
+        out = t + base[buy];
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // visits orders from the touch outwards, oldest first within a level,
+  // until f returns false
+  template <typename F>
+  void for_each_order(bool buy, F f) const {
+    if (order_count[buy] == 0) {
+      return;
+    }
+
+    const std::vector<Level>& side = levels[buy];
+    const tick_t step = buy ? -1 : 1;
+
+    for (tick_t t = best[buy] - base[buy]; t >= 0 && t < (tick_t)side.size(); t += step) {
+      for (uint32_t idx = side[t].head; idx != NIL; idx = nodes[idx].next) {
+        if (!f(nodes[idx])) {
+          return;
+        }
+      }
+    }
+  }
+
+  // returns the level for `tick`, growing the window to cover it if needed
+  Level* reserve_level(bool buy, tick_t tick) {
+    std::vector<Level>& side = levels[buy];
+
+    if (side.empty()) {
+      side.assign(INITIAL_LEVELS, Level{0, 0, NIL, NIL});
+      base[buy] = tick - (tick_t)INITIAL_LEVELS / 2;
+    } else if (tick < base[buy] || tick >= base[buy] + (tick_t)side.size()) {
+      tick_t lo = std::min(base[buy], tick);
+      tick_t hi = std::max(base[buy] + (tick_t)side.size(), tick + 1);
+
+      size_t new_size = side.size();
+      while (new_size < (size_t)(hi - lo) * 2) {
+        new_size *= 2;
+      }
+      if (new_size > MAX_LEVELS) {
+        return NULL;
+      }
+
+      tick_t new_base = lo - (tick_t)(new_size - (hi - lo)) / 2;
+      std::vector<Level> grown(new_size, Level{0, 0, NIL, NIL});
+      std::copy(side.begin(), side.end(), grown.begin() + (base[buy] - new_base));
+      side.swap(grown);
+      base[buy] = new_base;
+    }
+
+    return &side[tick - base[buy]];
+  }
+
+  uint32_t alloc_node() {
+    if (free_head != NIL) {
+      uint32_t idx = free_head;
+      free_head = nodes[idx].next;
+      return idx;
+    }
+    nodes.emplace_back();
+    return nodes.size() - 1;
+  }
+
+  void free_node(uint32_t idx) {
+    nodes[idx].next = free_head;
+    free_head = idx;
+  }
+
+  void remove(uint32_t idx) {
+    Node& order = nodes[idx];
+    Level& level = level_of(order);
+
+    if (order.prev != NIL) {
+      nodes[order.prev].next = order.next;
+    } else {
+      level.head = order.next;
+    }
+    if (order.next != NIL) {
+      nodes[order.next].prev = order.prev;
+    } else {
+      level.tail = order.prev;
+    }
+    level.quantity -= order.quantity;
+    volume[order.buy] -= order.quantity;
+    if (--level.count == 0) {
+      level_count[order.buy]--;
+    }
+
+    if (--order_count[order.buy] == 0) {
+      touch_moved(order.buy);
+    } else if (level.count == 0 && order.tick == best[order.buy]) {
+      bool found = next_level(order.buy, order.tick, best[order.buy]);
+      assert(found);
+      (void)found;
+      touch_moved(order.buy);
+    } else {
+      level_changed(order.buy, order.tick, -order.quantity);
+    }
+
+    free_node(idx);
+  }
+
+  void level_changed(bool buy, tick_t tick, quantity_t delta) {
+    add_depth(buy, tick, delta);
+    if (listener) {
+      listener->on_level_change(*this, buy, tick, delta);
+    }
+  }
+
+  void touch_moved(bool buy) {
+    refresh_depth(buy);
+    if (listener) {
+      listener->on_touch_change(*this, buy);
+    }
+  }
+
+  // applies a change of `delta` at `tick` (the touch has not moved) to the
+  // depth levels: the level may have changed size, appeared or emptied
+  void add_depth(bool buy, tick_t tick, quantity_t delta) {
+    tick_t* ticks = depth_ticks[buy];
+    int& n = depth_size[buy];
+
+    int rank = 0;
+    while (rank < n && more_aggressive(buy, ticks[rank], tick)) {
+      rank++;
+    }
+    const bool tracked = rank < n && ticks[rank] == tick;
+    const bool empty = levels[buy][tick - base[buy]].count == 0;
+
+    if (tracked && !empty) {
+      depth_qty[buy] += delta;
+      depth_weighted[buy] += delta * (depth_levels - rank);
+      return;
+    }
+
+    if (tracked) {
+      // emptied: close the gap, then take in the next level behind the last
+      // one if there is any we are not tracking
+      std::copy(ticks + rank + 1, ticks + n, ticks + rank);
+      n--;
+      tick_t next;
+      if (n < level_count[buy] && next_level(buy, n ? ticks[n - 1] : best[buy], next)) {
+        ticks[n++] = next;
+      }
+    } else if (!empty && (rank < n || n < depth_levels)) {
+      // a new level among (or right behind) the tracked ones; all the levels
+      // up to the last tracked one are tracked, so it is not a resize
+      if (n == depth_levels) {
+        n--;
+      }
+      std::copy_backward(ticks + rank, ticks + n, ticks + n + 1);
+      ticks[rank] = tick;
+      n++;
+    } else {
+      return; // behind the depth levels
+    }
+    sum_depth(buy);
+  }
+
+  // recomputes depth_qty and depth_weighted from the tracked levels
+  void sum_depth(bool buy) {
+    depth_qty[buy] = 0;
+    depth_weighted[buy] = 0;
+    for (int rank = 0; rank < depth_size[buy]; rank++) {
+      const quantity_t q = levels[buy][depth_ticks[buy][rank] - base[buy]].quantity;
+      depth_qty[buy] += q;
+      depth_weighted[buy] += q * (depth_levels - rank);
+    }
+  }
+
+  // rebuilds the depth levels from the level array, needed when the touch moves
+  void refresh_depth(bool buy) {
+    depth_size[buy] = 0;
+    const int want = std::min(depth_levels, level_count[buy]);
+    for_each_level(buy, [&](tick_t tick, quantity_t, uint32_t) {
+      depth_ticks[buy][depth_size[buy]++] = tick;
+      return depth_size[buy] < want;
+    });
+    sum_depth(buy);
+  }
+
+  template <typename Orders>
+  void print_order(std::ofstream& fout, const Node& x, const Orders& mine) const {
+    fout << px_t::from_ticks(x.tick) << ' ' << x.quantity;
+    if (mine.count(x.order_id)) {
+      fout << " (mine)";
+    }
+    fout << '\n';
+  }
+
+  std::vector<Level> levels[2];
+  tick_t best[2];
+  tick_t base[2];
+  int64_t order_count[2];
+  int level_count[2];
+  quantity_t volume[2];
+
+  int depth_levels;
+  tick_t depth_ticks[2][MAX_DEPTH_LEVELS]; // the first depth_size non-empty levels, touch first
+  int depth_size[2];
+  quantity_t depth_qty[2];
+  int64_t depth_weighted[2]; // sum of quantity * (depth_levels - rank)
+
+  std::vector<Node> nodes;
+  uint32_t free_head;
+  OrderIdMap<uint32_t> order_map;
+
+  LevelListener* listener;
+};
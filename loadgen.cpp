@@ -0,0 +1,433 @@
+#include "kirin.hpp"
+#include "latency.hpp"
+#include "order_budget.hpp"
+#include "order_id_map.hpp"
+#include "own_orders.hpp"
+#include "packet_bot.hpp"
+#include "price.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+
+#include <atomic>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+Load generator for the exchange: runs kirin.o's exchange (Manager::run_kirin) in
+a child process and connects `traders` trader processes to it through the real
+queue_manager IPC path, each sending a paced mix of resting orders, IOC orders
+and cancels.
+
+  traders=N   trader processes, each with its own queues and Trader limits (8)
+  tickers=T   tickers the orders are spread over, uniformly (1)
+  seconds=S   how long to run (10)
+  rate=R      actions per second per trader (900; Trader allows 1000)
+  cancel=P    fraction of actions that cancel one of the trader's resting orders (0.4)
+  ioc=P       fraction that are IOC orders crossing the book (0.1)
+  depth=D     resting orders go 1..D ticks behind the last trade price (20)
+  live=L      resting orders per trader before it only cancels (200)
+
+Every trader keeps within the exchange's limits with an OrderBudget, so what is
+measured is the exchange working, not it rejecting. At the end it prints what
+was sent and received per second, rejects and local drops, and:
+
+  order rtt    order sent -> first update naming it (ORDER, a fill, or a reject)
+  cancel rtt   cancel sent -> the CANCEL update
+
+Each trader is its own process, like a competitor: run_competitors() with more
+than one bot never gets any updates. The traders act from their receive threads
+at the end of each packet, so they rely on the exchange's own bots to keep
+packets coming; this measures the whole path a competitor sees, IPC included.
+The exchange classes are not declared anywhere outside kirin.o, so the matching
+engine cannot be driven directly from here.
+
+kirin.o matches every ticker on one thread behind one receive queue, so more
+tickers spread the same load over more books but not over more cores; comparing
+tickers=1 with tickers=10 at the same rate shows what the book count itself
+costs. The exchange lists tickers 0-9; orders on the others come back rejected
+with INVALID_TICKER, and show up as such in the report.
+
+usage: ./loadgen [traders=8] [tickers=1] [seconds=10] [rate=900] [cancel=0.4] [ioc=0.1] [depth=20] [live=200]
+*/
+
+
+struct LoadConfig {
+  int traders = 8;
+  int tickers = 1;
+  double seconds = 10;
+  double rate = 900;
+  double cancel = 0.4;
+  double ioc = 0.1;
+  int depth = 20;
+  size_t live = 200;
+};
+
+
+// one trader's results, in memory shared with the parent
+struct TraderStats {
+  TraderStats() : order_rtt("order rtt"), cancel_rtt("cancel rtt") {}
+
+  LatencyHistogram order_rtt, cancel_rtt;
+  std::atomic<uint64_t> orders{0}, iocs{0}, cancels{0}, updates{0};
+  std::atomic<uint64_t> rejects[Common::PNL_LIMIT_EXCEEDED + 1] = {};
+  uint64_t dropped[Common::PNL_LIMIT_EXCEEDED + 1] = {}; // copied from the budget at the end
+};
+
+
+class LoadBot : public PacketBot {
+public:
+  LoadBot(trader_id_t trader_id, const LoadConfig& config, TraderStats& stats, const std::atomic<bool>& running) :
+    PacketBot(trader_id), config(config), stats(stats), running(running), rng(trader_id),
+    cancel_sent(256), last_price(), position(), tokens(0), last_refill(0), last_expire(0) {
+    std::fill(last_price, last_price + MAX_NUM_TICKERS, px_t::from_price(100.0));
+    own.reserve(TraderLimits::MAX_OPEN_ORDERS);
+  }
+
+  void on_packet(const Update* updates, size_t n, Bot::Communicator& com) override {
+    stats.updates.fetch_add(n, std::memory_order_relaxed);
+    for (const Update* u = updates; u != updates + n; u++) {
+      switch (u->type) {
+        case Common::TRADE: on_trade(u->trade); break;
+        case Common::ORDER: on_order(u->order); break;
+        case Common::CANCEL: on_cancel(u->cancel); break;
+        case Common::REJECT_ORDER:
+          if (own.on_rejected(u->reject_order.order_id)) {
+            stats.rejects[u->reject_order.reason].fetch_add(1, std::memory_order_relaxed);
+          }
+          break;
+        case Common::REJECT_CANCEL:
+          // also when the order already filled or went, which is what most of these are
+          own.on_cancel_rejected(u->reject_cancel.order_id);
+          stats.rejects[u->reject_cancel.reason].fetch_add(1, std::memory_order_relaxed);
+          cancel_sent.erase(u->reject_cancel.order_id);
+          break;
+      }
+    }
+
+    if (running.load(std::memory_order_relaxed)) {
+      act(com);
+    }
+  }
+
+  // copies what is only kept locally into stats; once running is false
+  void publish() {
+    stats.order_rtt.merge(own.reply_latency);
+    for (int r = 0; r <= Common::PNL_LIMIT_EXCEEDED; r++) {
+      stats.dropped[r] = budget.dropped_count((Common::RejectReason)r);
+    }
+  }
+
+private:
+  void on_trade(const Common::TradeUpdate& update) {
+    last_price[update.ticker] = px_t::from_price(update.price);
+    if (own.on_fill(update.resting_order_id, update.quantity)) {
+      position[update.ticker] += update.buy ? -update.quantity : update.quantity;
+    }
+    if (own.on_fill(update.aggressing_order_id, update.quantity)) {
+      position[update.ticker] += update.buy ? update.quantity : -update.quantity;
+    }
+  }
+
+  void on_order(const Common::OrderUpdate& update) {
+    if (own.on_resting(update.order_id, update.quantity)) {
+      resting.push_back(update.order_id);
+    }
+  }
+
+  void on_cancel(const Common::CancelUpdate& update) {
+    own.on_cancelled(update.order_id);
+    const int64_t* sent = cancel_sent.find(update.order_id);
+    if (sent) {
+      stats.cancel_rtt.record(now_ns() - *sent);
+      cancel_sent.erase(update.order_id);
+    }
+  }
+
+  // spends the actions accrued since the last packet, at most 100ms worth
+  void act(Bot::Communicator& com) {
+    const int64_t now = now_ns();
+    if (last_refill) {
+      tokens = std::min(tokens + config.rate * (now - last_refill) / 1e9, config.rate / 10 + 1);
+    }
+    last_refill = now;
+
+    if (now - last_expire > 1000000000) {
+      last_expire = now;
+      own.expire_pending(now - 1000000000); // IOCs that found nothing to trade with
+    }
+
+    for (; tokens >= 1; tokens -= 1) {
+      const double r = std::uniform_real_distribution<double>(0, 1)(rng);
+      if (r < config.cancel || own.size() >= config.live) {
+        if (!cancel_one(com, now)) {
+          place(com, false, now);
+        }
+      } else {
+        place(com, r < config.cancel + config.ioc, now);
+      }
+    }
+  }
+
+  // a random resting order; resting holds ids that may since have finished
+  bool cancel_one(Bot::Communicator& com, int64_t now) {
+    while (!resting.empty()) {
+      size_t i = std::uniform_int_distribution<size_t>(0, resting.size() - 1)(rng);
+      const order_id_t id = resting[i];
+      resting[i] = resting.back();
+      resting.pop_back();
+
+      const OwnOrder* order = own.find(id);
+      if (!order || !order->resting()) {
+        continue;
+      }
+      if (budget.check_cancel(own.size(), now) != Common::NO_REASON) {
+        budget.on_dropped(Common::RATE_LIMIT_EXCEEDED);
+        resting.push_back(id);
+        return true; // the action is spent either way
+      }
+
+      own.on_cancel_sent(id);
+      com.place_cancel(Common::Cancel{order->ticker, id, trader_id});
+      budget.on_action(now);
+      cancel_sent[id] = now_ns();
+      stats.cancels.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+    return false;
+  }
+
+  void place(Bot::Communicator& com, bool ioc, int64_t now) {
+    const ticker_t ticker = std::uniform_int_distribution<int>(0, config.tickers - 1)(rng);
+
+    // lean against the position so it stays well inside the limit
+    bool buy = std::uniform_int_distribution<int>(0, 1)(rng);
+    if (position[ticker] > TraderLimits::MAX_POSITION / 4) {
+      buy = false;
+    } else if (position[ticker] < -TraderLimits::MAX_POSITION / 4) {
+      buy = true;
+    }
+
+    const int ticks = ioc ? -config.depth : std::uniform_int_distribution<int>(1, config.depth)(rng);
+    const px_t from = last_price[ticker];
+    const px_t price = buy ? from - px_t::from_ticks(ticks) : from + px_t::from_ticks(ticks);
+    if (price.ticks <= 0) {
+      return;
+    }
+
+    Common::Order order{
+      .ticker = ticker,
+      .price = price.to_price(),
+      .quantity = std::uniform_int_distribution<quantity_t>(1, 5)(rng),
+      .buy = buy,
+      .ioc = ioc,
+      .order_id = 0,
+      .trader_id = trader_id
+    };
+    Common::RejectReason reason =
+      budget.check_order(order, position[ticker], own.open_quantity(ticker, buy), own.size(), now);
+    if (reason != Common::NO_REASON) {
+      budget.on_dropped(reason);
+      return;
+    }
+
+    const int64_t sent = now_ns();
+    order.order_id = com.place_order(order);
+    budget.on_action(now);
+    own.on_sent(order, sent);
+    (ioc ? stats.iocs : stats.orders).fetch_add(1, std::memory_order_relaxed);
+  }
+
+  const LoadConfig& config;
+  TraderStats& stats;
+  const std::atomic<bool>& running;
+
+  OwnOrders own;
+  OrderBudget budget;
+
+  std::mt19937_64 rng;
+  std::vector<order_id_t> resting;
+  OrderIdMap<int64_t> cancel_sent;
+  px_t last_price[MAX_NUM_TICKERS];
+  quantity_t position[MAX_NUM_TICKERS];
+
+  double tokens;
+  int64_t last_refill;
+  int64_t last_expire;
+};
+
+
+// removes the exchange queues a previous run under this prefix left behind
+static void remove_queues(const std::string& prefix) {
+  DIR* dir = opendir("/dev/shm");
+  if (!dir) {
+    return;
+  }
+  while (dirent* e = readdir(dir)) {
+    if (strncmp(e->d_name, prefix.c_str(), prefix.size()) == 0) {
+      unlink(("/dev/shm/" + std::string(e->d_name)).c_str());
+    }
+  }
+  closedir(dir);
+}
+
+// runs one trader until running turns false, then publishes its stats and exits
+static void run_trader(std::string& prefix, trader_id_t id, const LoadConfig& config,
+                       TraderStats& stats, const std::atomic<bool>& running) {
+  LoadBot* bot = new LoadBot(id, config, stats, running);
+
+  // run_competitors does not return
+  std::thread publisher([&] {
+    while (running.load()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(500)); // let replies come in
+    bot->publish();
+    _exit(0);
+  });
+
+  std::vector<Bot::AbstractBot*> bots{bot};
+  Manager::Manager manager;
+  manager.run_competitors(prefix, bots);
+  publisher.join();
+}
+
+static void report(const LoadConfig& config, const TraderStats* traders, double elapsed) {
+  LatencyHistogram order_rtt("order rtt"), cancel_rtt("cancel rtt");
+  uint64_t orders = 0, iocs = 0, cancels = 0, updates = 0;
+  uint64_t rejects[Common::PNL_LIMIT_EXCEEDED + 1] = {}, dropped[Common::PNL_LIMIT_EXCEEDED + 1] = {};
+
+  for (const TraderStats* t = traders; t != traders + config.traders; t++) {
+    order_rtt.merge(t->order_rtt);
+    cancel_rtt.merge(t->cancel_rtt);
+    orders += t->orders;
+    iocs += t->iocs;
+    cancels += t->cancels;
+    updates += t->updates;
+    for (int r = 0; r <= Common::PNL_LIMIT_EXCEEDED; r++) {
+      rejects[r] += t->rejects[r];
+      dropped[r] += t->dropped[r];
+    }
+  }
+
+  std::cout << std::fixed << std::setprecision(0)
+            << config.traders << " traders, " << config.tickers << " tickers, " << elapsed << " s: "
+            << (orders + iocs + cancels) / elapsed << " actions/s ("
+            << orders / elapsed << " orders, " << iocs / elapsed << " ioc, "
+            << cancels / elapsed << " cancels), "
+            << updates / elapsed << " updates/s received over all traders" << std::endl;
+
+  static const char* names[] = {"none", "invalid parameters", "invalid trader id", "invalid ticker",
+                                "invalid order id", "rate limit", "open orders", "position", "pnl"};
+  std::cout << "rejected:";
+  for (int r = 1; r <= Common::PNL_LIMIT_EXCEEDED; r++) {
+    if (rejects[r]) {
+      std::cout << " " << rejects[r] << " " << names[r] << ";";
+    }
+  }
+  std::cout << " not sent:";
+  for (int r = 1; r <= Common::PNL_LIMIT_EXCEEDED; r++) {
+    if (dropped[r]) {
+      std::cout << " " << dropped[r] << " " << names[r] << ";";
+    }
+  }
+  std::cout << std::endl;
+
+  order_rtt.print(std::cout);
+  cancel_rtt.print(std::cout);
+}
+
+
+int main(int argc, const char ** argv) {
+  LoadConfig config;
+  for (int i = 1; i < argc; i++) {
+    const char* a = argv[i];
+    if (sscanf(a, "traders=%d", &config.traders) || sscanf(a, "tickers=%d", &config.tickers) ||
+        sscanf(a, "seconds=%lf", &config.seconds) ||
+        sscanf(a, "rate=%lf", &config.rate) || sscanf(a, "cancel=%lf", &config.cancel) ||
+        sscanf(a, "ioc=%lf", &config.ioc) || sscanf(a, "depth=%d", &config.depth) ||
+        sscanf(a, "live=%zu", &config.live)) {
+      continue;
+    }
+    fprintf(stderr, "unknown argument %s\n", a);
+    return 1;
+  }
+  if (config.traders < 1) {
+    fprintf(stderr, "traders must be at least 1\n");
+    return 1;
+  }
+  if (config.tickers < 1 || config.tickers > MAX_NUM_TICKERS) {
+    fprintf(stderr, "tickers must be 1..%d\n", MAX_NUM_TICKERS);
+    return 1;
+  }
+
+  // the stop flag and every trader's stats, shared with the children
+  size_t shared_size = alignof(TraderStats) + config.traders * sizeof(TraderStats);
+  void* shared = mmap(NULL, shared_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (shared == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+  std::atomic<bool>& running = *new (shared) std::atomic<bool>(true);
+  TraderStats* traders = reinterpret_cast<TraderStats*>((char*)shared + alignof(TraderStats));
+  for (int i = 0; i < config.traders; i++) {
+    new (&traders[i]) TraderStats();
+  }
+
+  std::string prefix = "load";
+  remove_queues(prefix);
+
+  pid_t exchange = fork();
+  if (exchange < 0) {
+    perror("fork");
+    return 1;
+  }
+  if (exchange == 0) {
+    // the exchange prints every trade and PnL; keep that out of the report
+    if (!freopen("/dev/null", "w", stdout)) {
+      _exit(1);
+    }
+    Manager::Manager manager;
+    manager.run_kirin(prefix, config.traders);
+    _exit(0);
+  }
+  sleep(2); // for the exchange to create its queues
+
+  std::vector<pid_t> children;
+  for (int i = 0; i < config.traders; i++) {
+    // ids are drawn here: the children would all draw the same one
+    trader_id_t id = Manager::Manager::get_random_trader_id();
+    pid_t child = fork();
+    if (child == 0) {
+      run_trader(prefix, id, config, traders[i], running);
+      _exit(0);
+    }
+    children.push_back(child);
+  }
+
+  const int64_t start = now_ns();
+  std::this_thread::sleep_for(std::chrono::duration<double>(config.seconds));
+  running = false;
+  const double elapsed = (now_ns() - start) / 1e9;
+  for (pid_t child : children) {
+    waitpid(child, NULL, 0);
+  }
+  report(config, traders, elapsed);
+
+  // the exchange runs until it is killed, and does not stop on SIGTERM
+  kill(exchange, SIGKILL);
+  waitpid(exchange, NULL, 0);
+  remove_queues(prefix);
+  return 0;
+}
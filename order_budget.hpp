@@ -0,0 +1,113 @@
+#pragma once
+
+#include "kirin.hpp"
+#include <cstdint>
+#include <cstdlib>
+
+#include <vector>
+
+
+// what Trader in kirin.o allows each trader
+struct TraderLimits {
+  static const int64_t RATE_WINDOW_NS = 10000000000; // trailing window for actions
+  static const size_t MAX_ACTIONS = 10000;           // orders and cancels per window
+  static const size_t MAX_OPEN_ORDERS = 500;
+  static const quantity_t MAX_POSITION = 2000;       // |position + open same-side + new|
+  // check_pnl_limit always passes
+};
+
+
+/*
+The exchange's limits as seen from our side, so that an action the exchange is
+bound to reject is not sent at all: a rejected message costs the round trip and
+still counts against the rate limit.
+
+The rate limit is a trailing window of the last MAX_ACTIONS action times, like
+Trader keeps, rather than a token bucket: a bucket refilling at MAX_ACTIONS per
+window would let through bursts that the trailing window rejects. Our times are
+taken when an action is admitted, before the exchange sees it, so the window is
+stretched by `margin_ns` to stay on the safe side.
+
+The open order count and quantities come from the own-order table, which holds
+everything in flight as well as what rests, so it never undercounts.
+*/
+class OrderBudget {
+public:
+  OrderBudget(int64_t margin_ns = 100000000) :
+    window_ns(TraderLimits::RATE_WINDOW_NS + margin_ns), times(TraderLimits::MAX_ACTIONS, INT64_MIN),
+    next(0), dropped() {}
+
+  // actions the rate limit still allows at `now`
+  size_t actions_left(int64_t now) const {
+    // times is a ring in time order starting at next; count the expired prefix
+    size_t lo = 0, hi = times.size();
+    while (lo < hi) {
+      size_t mid = (lo + hi) / 2;
+      if (at(mid) <= now - window_ns) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    return lo;
+  }
+
+  bool can_act(int64_t now) const {
+    return times[next] <= now - window_ns;
+  }
+
+  /* What the exchange would reject a new order with (NO_REASON if nothing).
+  `open_orders` is how many of ours are open or in flight, `open_same_side` the
+  open quantity on the order's ticker and side.
+  */
+  Common::RejectReason check_order(const Common::Order& order, quantity_t position,
+                                   quantity_t open_same_side, size_t open_orders, int64_t now) const {
+    quantity_t exposure = open_same_side + order.quantity;
+    if (std::abs(position + (order.buy ? exposure : -exposure)) > TraderLimits::MAX_POSITION) {
+      return Common::POSITION_LIMIT_EXCEEDED;
+    }
+    if (!can_act(now)) {
+      return Common::RATE_LIMIT_EXCEEDED;
+    }
+    if (open_orders >= TraderLimits::MAX_OPEN_ORDERS) {
+      return Common::OPEN_ORDERS_EXCEEDED;
+    }
+    return Common::NO_REASON;
+  }
+
+  // Trader also turns cancels away once the open order limit is reached
+  Common::RejectReason check_cancel(size_t open_orders, int64_t now) const {
+    if (!can_act(now) || open_orders >= TraderLimits::MAX_OPEN_ORDERS) {
+      return Common::RATE_LIMIT_EXCEEDED;
+    }
+    return Common::NO_REASON;
+  }
+
+  // an action was sent at `now`
+  void on_action(int64_t now) {
+    times[next] = now;
+    next = next + 1 == times.size() ? 0 : next + 1;
+  }
+
+  // an action was not sent because of `reason`
+  void on_dropped(Common::RejectReason reason) {
+    dropped[reason]++;
+  }
+
+  uint64_t dropped_count(Common::RejectReason reason) const {
+    return dropped[reason];
+  }
+
+private:
+  // i-th oldest action time
+  int64_t at(size_t i) const {
+    size_t j = next + i;
+    return times[j >= times.size() ? j - times.size() : j];
+  }
+
+  int64_t window_ns;
+  std::vector<int64_t> times; // ring of the last MAX_ACTIONS action times
+  size_t next;                // oldest entry, and where the next one goes
+
+  uint64_t dropped[Common::PNL_LIMIT_EXCEEDED + 1];
+};
@@ -0,0 +1,345 @@
+#pragma once
+
+#include "kirin.hpp"
+#include "latency.hpp"
+#include "spsc_ring.hpp"
+#include "thread_policy.hpp"
+#include "wire.hpp"
+#include <cassert>
+#include <iostream>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+
+/*
+Where the bot's orders and cancels leave the process.
+
+SYNC calls Communicator::place_order/place_cancel on the strategy thread, which
+is what the bot always did: the call returns once the message is in the exchange
+queue.
+
+ASYNC pushes each action into an SpscRing and returns at once; a dedicated sender
+thread makes the Communicator calls. An order's id is only known when
+Communicator::place_order returns on that thread, so ids travel back through a
+second ring and reach the strategy via drain_acks(), which must run before the
+strategy looks at any update. drain_acks() first waits out an action that is in
+the middle of being sent, so an update about one of our orders can never be seen
+before the order is known to be ours.
+
+The Communicator (in kirin.o) still draws ids from its own generator under its
+own mutex; in ASYNC mode only the sender thread calls it, so that lock is never
+contended.
+
+SIM works like SYNC but never touches the Communicator: orders get ids from a
+local counter and nothing is sent. It is for driving the bot offline, e.g. from
+a capture replay.
+
+A Batch collects a whole requote (cancels, then new orders) and submit() hands
+it over in one go: in ASYNC mode that is a single ring publish for the lot, and
+the sender thread then sends the actions back to back in the order they were
+added. Each action is still its own Communicator call and exchange message,
+since the exchange side (kirin.o) has no multi-action message.
+
+submit_latency is what a place_order/place_cancel/submit call costs the
+strategy; wire_latency runs from that call to the Communicator call returning,
+i.e. the message being handed to the exchange queue, per action. Every order
+reaches the strategy with the time it went out, so it can time the exchange's
+reply against it.
+*/
+class OrderGateway {
+private:
+  // an order travels to the sender in wire form, which with the union keeps a
+  // ring slot at 56 bytes instead of 88
+  struct Action {
+    enum Type : uint8_t { ORDER, CANCEL } type;
+    int64_t enqueued_ns;
+    union {
+      Wire::Order order;
+      Common::Cancel cancel;
+    };
+
+    static Action make(const Common::Order& order, int64_t enqueued_ns) {
+      Action a;
+      a.type = ORDER;
+      a.enqueued_ns = enqueued_ns;
+      a.order = Wire::encode(order);
+      return a;
+    }
+
+    static Action make(const Common::Cancel& cancel, int64_t enqueued_ns) {
+      Action a;
+      a.type = CANCEL;
+      a.enqueued_ns = enqueued_ns;
+      a.cancel = cancel;
+      return a;
+    }
+  };
+  static_assert(sizeof(Action) == 56, "Action no longer fits its 56 byte slot");
+
+public:
+  enum Mode { SYNC, ASYNC, SIM };
+
+  // Reuse one Batch (clear() between uses) so building it never allocates.
+  class Batch {
+  public:
+    Batch() {
+      actions.reserve(64);
+    }
+
+    void cancel(const Common::Cancel& cancel) {
+      actions.push_back(Action::make(cancel, 0));
+    }
+
+    void order(const Common::Order& order) {
+      actions.push_back(Action::make(order, 0));
+    }
+
+    size_t size() const {
+      return actions.size();
+    }
+
+    bool empty() const {
+      return actions.empty();
+    }
+
+    void clear() {
+      actions.clear();
+    }
+
+  private:
+    friend class OrderGateway;
+    std::vector<Action> actions;
+  };
+
+  OrderGateway() :
+    submit_latency("gw submit"), wire_latency("gw to wire"),
+    mode(SYNC), com(NULL), sim_next_id(SIM_FIRST_ID), spin_limit(SpinWait::default_limit()), running(false), sending(0), acked(0),
+    orders_pushed(0), acks_drained(0) {}
+
+  ~OrderGateway() {
+    stop();
+  }
+
+  // `sender` is how the ASYNC sender thread runs; its spin_limit is also how
+  // drain_acks waits for it
+  void start(Bot::Communicator& c, Mode m, const ThreadPolicy& sender = ThreadPolicy()) {
+    assert(!running);
+    com = &c;
+    mode = m;
+    sender_policy = sender;
+    spin_limit = sender.spin_limit;
+    if (mode == ASYNC) {
+      running = true;
+      sender_thread = std::thread(&OrderGateway::run, this);
+    }
+  }
+
+  void stop() {
+    if (running.exchange(false)) {
+      sender_thread.join();
+    }
+  }
+
+  Mode get_mode() const {
+    return mode;
+  }
+
+  // the exchange order id in SYNC/SIM mode, 0 in ASYNC mode (the id comes back through drain_acks)
+  order_id_t place_order(const Common::Order& order) {
+    const int64_t t0 = now_ns();
+
+    if (mode != ASYNC) {
+      order_id_t id = send(order);
+      const int64_t t1 = now_ns();
+      submit_latency.record(t1 - t0);
+      wire_latency.record(t1 - t0);
+      return id;
+    }
+
+    push(Action::make(order, t0));
+    orders_pushed++;
+    submit_latency.record(now_ns() - t0);
+    return 0;
+  }
+
+  void place_cancel(const Common::Cancel& cancel) {
+    const int64_t t0 = now_ns();
+
+    if (mode != ASYNC) {
+      send(cancel);
+      const int64_t t1 = now_ns();
+      submit_latency.record(t1 - t0);
+      wire_latency.record(t1 - t0);
+      return;
+    }
+
+    push(Action::make(cancel, t0));
+    submit_latency.record(now_ns() - t0);
+  }
+
+  // sends every action in the batch, in order. In SYNC/SIM mode on_sent gets each
+  // order with its exchange id and send time as it goes out; in ASYNC mode it is
+  // not called and the ids come back through drain_acks like any other order.
+  template <typename F>
+  void submit(Batch& batch, F on_sent) {
+    const int64_t t0 = now_ns();
+
+    if (mode != ASYNC) {
+      for (Action& a : batch.actions) {
+        if (a.type == Action::ORDER) {
+          Common::Order order = Wire::decode(a.order);
+          order.order_id = send(order);
+          const int64_t sent = now_ns();
+          on_sent(order, sent);
+          wire_latency.record(sent - t0);
+        } else {
+          send(a.cancel);
+          wire_latency.record(now_ns() - t0);
+        }
+      }
+      submit_latency.record(now_ns() - t0);
+      return;
+    }
+
+    for (Action& a : batch.actions) {
+      a.enqueued_ns = t0;
+      orders_pushed += a.type == Action::ORDER;
+    }
+
+    const Action* next = batch.actions.data();
+    size_t left = batch.actions.size();
+    while (left) {
+      size_t n = std::min(left, actions.capacity());
+      while (!actions.try_push_n(next, n)) {
+        std::this_thread::yield(); // sender is behind by a whole ring; back off
+      }
+      next += n;
+      left -= n;
+    }
+    submit_latency.record(now_ns() - t0);
+  }
+
+  // hands every order sent since the last call, with its exchange id filled in
+  // and the time it was sent, to on_ack; a no-op in SYNC/SIM mode or when nothing
+  // is in flight
+  template <typename F>
+  void drain_acks(F on_ack) {
+    if (acks_drained == orders_pushed) {
+      return;
+    }
+
+    // if the sender is inside a Communicator call, wait for it; normally a few
+    // microseconds, but the SpinWait yields in case it was descheduled there.
+    // Acks are popped while waiting so a full ack ring cannot stall the sender.
+    const uint64_t target = sending.load(std::memory_order_acquire);
+    Ack ack;
+    SpinWait waiter(spin_limit);
+
+    for (;;) {
+      bool done = acked.load(std::memory_order_acquire) >= target;
+      while (acks.try_pop(ack)) {
+        acks_drained++;
+        on_ack(Wire::decode(ack.order), ack.sent_ns);
+      }
+      if (done) {
+        break;
+      }
+      waiter.wait();
+    }
+  }
+
+  // orders handed to the gateway whose ids the strategy has not seen yet
+  uint64_t orders_in_flight() const {
+    return orders_pushed - acks_drained;
+  }
+
+  void print_stats(std::ostream& os) const {
+    os << (mode == SYNC ? "[sync]" : mode == ASYNC ? "[async]" : "[sim]") << std::endl;
+    submit_latency.print(os);
+    wire_latency.print(os);
+  }
+
+  LatencyHistogram submit_latency;
+  LatencyHistogram wire_latency;
+
+private:
+  struct Ack {
+    Wire::Order order; // with its exchange id
+    int64_t sent_ns;
+  };
+
+  // the strategy thread's own sends, in SYNC and SIM mode
+  order_id_t send(const Common::Order& order) {
+    return mode == SIM ? ++sim_next_id : com->place_order(order);
+  }
+
+  void send(const Common::Cancel& cancel) {
+    if (mode != SIM) {
+      com->place_cancel(cancel);
+    }
+  }
+
+  void push(const Action& a) {
+    while (!actions.try_push(a)) {
+      std::this_thread::yield(); // sender is behind by a whole ring; back off
+    }
+  }
+
+  void run() {
+    Action a;
+    uint64_t seq = 0;
+    SpinWait idle(spin_limit);
+    sender_policy.apply("gw sender");
+
+    while (running.load(std::memory_order_relaxed)) {
+      if (!actions.try_pop(a)) {
+        idle.wait();
+        continue;
+      }
+      idle.reset();
+
+      sending.store(++seq, std::memory_order_release);
+
+      if (a.type == Action::ORDER) {
+        Common::Order order = Wire::decode(a.order);
+        Ack ack{a.order, 0};
+        ack.order.order_id = com->place_order(order);
+        ack.sent_ns = now_ns();
+        wire_latency.record(ack.sent_ns - a.enqueued_ns);
+        while (!acks.try_push(ack)) {
+          std::this_thread::yield();
+        }
+      } else {
+        com->place_cancel(a.cancel);
+        wire_latency.record(now_ns() - a.enqueued_ns);
+      }
+
+      acked.store(seq, std::memory_order_release);
+    }
+  }
+
+  // SIM ids count up from here, well clear of the synthetic feeds' small ids
+  static const order_id_t SIM_FIRST_ID = (order_id_t)1 << 62;
+
+  Mode mode;
+  Bot::Communicator* com;
+  order_id_t sim_next_id;
+  int spin_limit;
+  ThreadPolicy sender_policy;
+
+  std::thread sender_thread;
+  std::atomic<bool> running;
+  std::atomic<uint64_t> sending; // sequence number of the action being sent
+  std::atomic<uint64_t> acked;   // last sequence number fully sent and acked
+
+  // strategy thread only
+  uint64_t orders_pushed;
+  uint64_t acks_drained;
+
+  SpscRing<Action, 4096> actions;     // strategy -> sender
+  SpscRing<Ack, 4096> acks;           // sender -> strategy, orders with their ids
+};
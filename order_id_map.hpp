@@ -0,0 +1,310 @@
+#pragma once
+
+#include "kirin.hpp"
+#include <cstddef>
+#include <cstdint>
+
+#include <vector>
+
+
+/*
+Flat hash map from order ids to V, for ids that are already close to random
+(the Communicator draws them from a 64-bit Mersenne Twister).
+
+Open addressing with linear probing over one array of {id, value} entries, so a
+lookup is usually a single cache line. The slot is the high bits of a Fibonacci
+multiply, one instruction that also spreads sequential ids (the synthetic feeds
+use those). Erase shifts later entries of the probe run back instead of leaving
+tombstones, so lookups never get slower as orders come and go. The table doubles
+when it is half full; reserve() up front and it never allocates on the hot path.
+
+Id 0 marks an empty slot, so an order with id 0 is kept in a separate entry.
+
+Entries have `first` and `second` like std::pair, so range-for code written for
+std::unordered_map works unchanged. Any insert or erase invalidates iterators
+and pointers to values.
+*/
+template <typename V>
+class OrderIdMap {
+public:
+  struct Entry {
+    order_id_t first;
+    V second;
+  };
+
+  class iterator {
+  public:
+    iterator(OrderIdMap* map, size_t i) : map(map), i(i) {
+      skip();
+    }
+
+    Entry& operator*() const {
+      return map->entry(i);
+    }
+
+    Entry* operator->() const {
+      return &map->entry(i);
+    }
+
+    iterator& operator++() {
+      i++;
+      skip();
+      return *this;
+    }
+
+    bool operator==(const iterator& other) const {
+      return i == other.i;
+    }
+
+    bool operator!=(const iterator& other) const {
+      return i != other.i;
+    }
+
+  private:
+    void skip() {
+      while (i < map->end_index() && !map->occupied(i)) {
+        i++;
+      }
+    }
+
+    OrderIdMap* map;
+    size_t i;
+  };
+
+  class const_iterator {
+  public:
+    const_iterator(const OrderIdMap* map, size_t i) : map(map), i(i) {
+      skip();
+    }
+
+    const Entry& operator*() const {
+      return map->entry(i);
+    }
+
+    const Entry* operator->() const {
+      return &map->entry(i);
+    }
+
+    const_iterator& operator++() {
+      i++;
+      skip();
+      return *this;
+    }
+
+    bool operator==(const const_iterator& other) const {
+      return i == other.i;
+    }
+
+    bool operator!=(const const_iterator& other) const {
+      return i != other.i;
+    }
+
+  private:
+    void skip() {
+      while (i < map->end_index() && !map->occupied(i)) {
+        i++;
+      }
+    }
+
+    const OrderIdMap* map;
+    size_t i;
+  };
+
+  explicit OrderIdMap(size_t expected = 1024) : used(0), has_zero(false) {
+    zero = Entry{0, V()};
+    allocate(capacity_for(expected));
+  }
+
+  // makes room for `expected` entries without further allocation
+  void reserve(size_t expected) {
+    if (capacity_for(expected) > slots.size()) {
+      rehash(capacity_for(expected));
+    }
+  }
+
+  size_t size() const {
+    return used;
+  }
+
+  bool empty() const {
+    return used == 0;
+  }
+
+  V* find(order_id_t id) {
+    if (id == 0) {
+      return has_zero ? &zero.second : NULL;
+    }
+    for (size_t i = home(id); ; i = (i + 1) & mask) {
+      if (slots[i].first == id) {
+        return &slots[i].second;
+      }
+      if (slots[i].first == 0) {
+        return NULL;
+      }
+    }
+  }
+
+  const V* find(order_id_t id) const {
+    return const_cast<OrderIdMap*>(this)->find(id);
+  }
+
+  size_t count(order_id_t id) const {
+    return find(id) != NULL;
+  }
+
+  // false (and no change) if the id is already there
+  bool emplace(order_id_t id, const V& value) {
+    if (find(id)) {
+      return false;
+    }
+    insert_new(id, value);
+    return true;
+  }
+
+  // the value for id, default-constructed and inserted if missing
+  V& operator[](order_id_t id) {
+    V* v = find(id);
+    if (v) {
+      return *v;
+    }
+    return *insert_new(id, V());
+  }
+
+  bool erase(order_id_t id) {
+    if (id == 0) {
+      if (!has_zero) {
+        return false;
+      }
+      has_zero = false;
+      used--;
+      return true;
+    }
+
+    size_t i = home(id);
+    for (; slots[i].first != id; i = (i + 1) & mask) {
+      if (slots[i].first == 0) {
+        return false;
+      }
+    }
+
+    // backward shift: pull later entries of the run into the hole when that
+    // does not move them in front of their home slot
+    for (size_t j = (i + 1) & mask; slots[j].first != 0; j = (j + 1) & mask) {
+      size_t h = home(slots[j].first);
+      if (((j - h) & mask) >= ((j - i) & mask)) {
+        slots[i] = slots[j];
+        i = j;
+      }
+    }
+    slots[i].first = 0;
+    used--;
+    return true;
+  }
+
+  void clear() {
+    for (Entry& e : slots) {
+      e.first = 0;
+    }
+    has_zero = false;
+    used = 0;
+  }
+
+  iterator begin() {
+    return iterator(this, 0);
+  }
+
+  iterator end() {
+    return iterator(this, end_index());
+  }
+
+  const_iterator begin() const {
+    return const_iterator(this, 0);
+  }
+
+  const_iterator end() const {
+    return const_iterator(this, end_index());
+  }
+
+private:
+  // at most half full
+  static size_t capacity_for(size_t expected) {
+    size_t cap = 16;
+    while (cap < 2 * expected) {
+      cap *= 2;
+    }
+    return cap;
+  }
+
+  size_t home(order_id_t id) const {
+    return (id * 0x9E3779B97F4A7C15ULL) >> shift;
+  }
+
+  V* insert_new(order_id_t id, const V& value) {
+    if (id == 0) {
+      has_zero = true;
+      zero.second = value;
+      used++;
+      return &zero.second;
+    }
+
+    if (2 * (used + 1) > slots.size()) {
+      rehash(slots.size() * 2);
+    }
+
+    size_t i = home(id);
+    while (slots[i].first != 0) {
+      i = (i + 1) & mask;
+    }
+    slots[i] = Entry{id, value};
+    used++;
+    return &slots[i].second;
+  }
+
+  void allocate(size_t cap) {
+    slots.assign(cap, Entry{0, V()});
+    mask = cap - 1;
+    shift = 64 - __builtin_ctzll(cap);
+  }
+
+  void rehash(size_t cap) {
+    std::vector<Entry> old;
+    old.swap(slots);
+    allocate(cap);
+
+    for (const Entry& e : old) {
+      if (e.first != 0) {
+        size_t i = home(e.first);
+        while (slots[i].first != 0) {
+          i = (i + 1) & mask;
+        }
+        slots[i] = e;
+      }
+    }
+  }
+
+  // slots, then the id-0 entry
+  size_t end_index() const {
+    return slots.size() + 1;
+  }
+
+  bool occupied(size_t i) const {
+    return i < slots.size() ? slots[i].first != 0 : has_zero;
+  }
+
+  Entry& entry(size_t i) {
+    return i < slots.size() ? slots[i] : zero;
+  }
+
+  const Entry& entry(size_t i) const {
+    return i < slots.size() ? slots[i] : zero;
+  }
+
+  std::vector<Entry> slots;
+  size_t mask;
+  int shift;
+  size_t used;
+
+  bool has_zero;
+  Entry zero;
+};
+
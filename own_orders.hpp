@@ -0,0 +1,274 @@
+#pragma once
+
+#include "kirin.hpp"
+#include "latency.hpp"
+#include "order_id_map.hpp"
+#include "ticker_registry.hpp"
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <vector>
+
+
+// one of our orders as the exchange last described it; order.quantity is what
+// is still open
+struct OwnOrder : Common::Order {
+  enum Status : uint8_t {
+    PENDING_NEW,    // sent, nothing heard back yet
+    LIVE,           // resting, nothing filled
+    PARTIAL,        // resting, partly filled
+    PENDING_CANCEL, // a cancel is on its way
+    DONE,           // filled, cancelled or rejected; no longer in the table
+    NUM_STATUSES
+  };
+
+  quantity_t filled;
+  int64_t sent_ns;
+  uint32_t side_index; // position in OwnOrders' list for its ticker and side
+  Status status;
+  bool replied; // the exchange has named the order (a trade can come before its ORDER update)
+
+  bool resting() const {
+    return status == LIVE || status == PARTIAL;
+  }
+};
+
+
+// our orders on one ticker, by side (buy = 1)
+struct OwnSides {
+  OwnSides(ticker_t) : open_qty() {}
+
+  quantity_t open_qty[2];         // open or in flight
+  std::vector<order_id_t> ids[2]; // in no particular order
+};
+
+
+/*
+Every order of ours that is not done yet, with where it is in its lifecycle:
+
+  PENDING_NEW --ORDER update--> LIVE --fill--> PARTIAL
+       |                         |  \             |
+       |                         |   cancel sent  |
+       |                         |        \       |
+       |                         |    PENDING_CANCEL (reject: back to LIVE/PARTIAL)
+       |                         |          |
+       +-------------------------+----------+--> DONE on full fill, CANCEL update or reject
+
+Each exchange event is one lookup on the order id. A done order is erased right
+away, so the table only ever holds what is open or in flight, which the exchange
+itself caps (Trader allows 499 open orders); expire_pending() clears out orders
+whose reply never came.
+
+The first reply naming an order (its ORDER update, a trade it aggressed in, or
+its reject) is timed against the send in reply_latency.
+
+The ids are also listed per ticker and side (on_side()), so a requote visits
+only its own side of one ticker rather than every order we have. Those lists
+and the open quantities live in a TickerRegistry, so only tickers we have
+traded on carry them.
+
+Iterating gives {id, OwnOrder} entries, in every state but DONE.
+*/
+class OwnOrders {
+public:
+  OwnOrders(size_t expected = 64) :
+    reply_latency("order rtt"), orders(expected), counts() {}
+
+  // room for `expected` orders in flight without allocating on the hot path
+  void reserve(size_t expected) {
+    orders.reserve(expected);
+  }
+
+  void on_sent(const Common::Order& order, int64_t sent_ns) {
+    OwnOrder own;
+    static_cast<Common::Order&>(own) = order;
+    own.filled = 0;
+    own.sent_ns = sent_ns;
+    OwnSides& sides = tickers.get(order.ticker);
+    own.side_index = sides.ids[order.buy].size();
+    own.status = OwnOrder::PENDING_NEW;
+    own.replied = false;
+
+    if (orders.emplace(order.order_id, own)) {
+      counts[OwnOrder::PENDING_NEW]++;
+      sides.open_qty[order.buy] += order.quantity;
+      sides.ids[order.buy].push_back(order.order_id);
+    }
+  }
+
+  // the order rests on the book with `remaining` open; false if not ours
+  bool on_resting(order_id_t id, quantity_t remaining) {
+    OwnOrder* own = orders.find(id);
+    if (!own) {
+      return false;
+    }
+
+    replied(*own);
+    set_quantity(*own, remaining);
+    if (own->status == OwnOrder::PENDING_NEW) {
+      set_status(*own, own->filled ? OwnOrder::PARTIAL : OwnOrder::LIVE);
+    }
+    return true;
+  }
+
+  // `quantity` of the order traded; false if not ours
+  bool on_fill(order_id_t id, quantity_t quantity) {
+    OwnOrder* own = orders.find(id);
+    if (!own) {
+      return false;
+    }
+
+    replied(*own);
+    own->filled += quantity;
+    set_quantity(*own, own->quantity - quantity);
+    if (own->quantity <= 0) {
+      done(id, *own);
+    } else if (own->status == OwnOrder::LIVE) {
+      set_status(*own, OwnOrder::PARTIAL);
+    }
+    return true;
+  }
+
+  // the exchange took the order off the book (a CANCEL update)
+  bool on_cancelled(order_id_t id) {
+    OwnOrder* own = orders.find(id);
+    if (!own) {
+      return false;
+    }
+    done(id, *own);
+    return true;
+  }
+
+  bool on_rejected(order_id_t id) {
+    OwnOrder* own = orders.find(id);
+    if (!own) {
+      return false;
+    }
+    replied(*own);
+    done(id, *own);
+    return true;
+  }
+
+  // we asked for the order to be cancelled; false if it is not resting
+  bool on_cancel_sent(order_id_t id) {
+    OwnOrder* own = orders.find(id);
+    if (!own || !own->resting()) {
+      return false;
+    }
+    set_status(*own, OwnOrder::PENDING_CANCEL);
+    return true;
+  }
+
+  // the cancel was refused; if the order is still here it is still resting
+  bool on_cancel_rejected(order_id_t id) {
+    OwnOrder* own = orders.find(id);
+    if (!own || own->status != OwnOrder::PENDING_CANCEL) {
+      return false;
+    }
+    set_status(*own, own->filled ? OwnOrder::PARTIAL : OwnOrder::LIVE);
+    return true;
+  }
+
+  // drops PENDING_NEW orders sent before `cutoff_ns`, assuming the message was
+  // lost; returns how many. One that already traded as the aggressor is kept,
+  // its ORDER update is still to come, unless it is an IOC: those never rest,
+  // so nothing more will be heard about them
+  size_t expire_pending(int64_t cutoff_ns) {
+    std::vector<order_id_t> lost;
+    for (const auto& x : orders) {
+      const OwnOrder& own = x.second;
+      if (own.status == OwnOrder::PENDING_NEW && (!own.replied || own.ioc) && own.sent_ns < cutoff_ns) {
+        lost.push_back(x.first);
+      }
+    }
+    // not while iterating: erase moves entries
+    for (order_id_t id : lost) {
+      done(id, *orders.find(id));
+    }
+    return lost.size();
+  }
+
+  const OwnOrder* find(order_id_t id) const {
+    return orders.find(id);
+  }
+
+  size_t count(order_id_t id) const {
+    return orders.count(id);
+  }
+
+  size_t size() const {
+    return orders.size();
+  }
+
+  // ids of our orders open or in flight on one side of a ticker, in no
+  // particular order; look each up with find()
+  const std::vector<order_id_t>& on_side(ticker_t ticker, bool buy) const {
+    static const std::vector<order_id_t> none;
+    const OwnSides* sides = tickers.find(ticker);
+    return sides ? sides->ids[buy] : none;
+  }
+
+  // quantity of our orders open or in flight on one side of a ticker
+  quantity_t open_quantity(ticker_t ticker, bool buy) const {
+    const OwnSides* sides = tickers.find(ticker);
+    return sides ? sides->open_qty[buy] : 0;
+  }
+
+  // orders currently in `status`
+  size_t in_status(OwnOrder::Status status) const {
+    return counts[status];
+  }
+
+  OrderIdMap<OwnOrder>::const_iterator begin() const {
+    return orders.begin();
+  }
+
+  OrderIdMap<OwnOrder>::const_iterator end() const {
+    return orders.end();
+  }
+
+  // order sent -> the first reply from the exchange naming it
+  LatencyHistogram reply_latency;
+
+private:
+  void replied(OwnOrder& own) {
+    if (!own.replied) {
+      reply_latency.record(now_ns() - own.sent_ns);
+      own.replied = true;
+    }
+  }
+
+  void set_status(OwnOrder& own, OwnOrder::Status status) {
+    counts[own.status]--;
+    counts[status]++;
+    own.status = status;
+  }
+
+  void set_quantity(OwnOrder& own, quantity_t quantity) {
+    tickers.get(own.ticker).open_qty[own.buy] +=
+      std::max<quantity_t>(quantity, 0) - std::max<quantity_t>(own.quantity, 0);
+    own.quantity = quantity;
+  }
+
+  void done(order_id_t id, OwnOrder& own) {
+    set_quantity(own, 0);
+    counts[own.status]--;
+    counts[OwnOrder::DONE]++;
+
+    // swap-remove from its side list
+    std::vector<order_id_t>& side = tickers.get(own.ticker).ids[own.buy];
+    const uint32_t i = own.side_index;
+    if (i + 1 != side.size()) {
+      side[i] = side.back();
+      orders.find(side[i])->side_index = i;
+    }
+    side.pop_back();
+
+    orders.erase(id);
+  }
+
+  OrderIdMap<OwnOrder> orders;
+  size_t counts[OwnOrder::NUM_STATUSES]; // DONE counts every order ever finished
+  TickerRegistry<OwnSides> tickers; // every ticker we have sent an order on
+};
@@ -0,0 +1,141 @@
+#pragma once
+
+#include "kirin.hpp"
+#include "latency.hpp"
+
+#include <vector>
+
+
+/*
+One exchange update of any type, as the communicator decoded it. The Common
+update structs are plain data, so the whole record is trivially copyable and a
+packet is one flat array of these.
+*/
+struct Update {
+  Common::UpdateType type;
+  union {
+    Common::TradeUpdate trade;
+    Common::OrderUpdate order;
+    Common::CancelUpdate cancel;
+    Common::RejectOrderUpdate reject_order;
+    Common::RejectCancelUpdate reject_cancel;
+  };
+};
+
+
+/*
+A bot that sees each packet as a whole: the per-type callbacks only append the
+update to a reused array, and on_packet() gets the complete packet once it ends,
+so the strategy handles it in one loop with one switch instead of one virtual
+call per update.
+
+Communicator::communicate() (kirin.o) still decodes every received message into
+its update struct and calls through the AbstractBot vtable, whose layout is fixed
+by kirin.o; that copy cannot be skipped from here. What this saves is everything
+after it: the strategy's own per-update dispatch, and the bot keeps no state
+between the callbacks of a packet.
+
+With `conflate` on, every ticker a TRADE, ORDER or CANCEL touched during the
+packet also gets one on_book_changed() after on_packet(), in the order the
+tickers were first touched. A strategy that decides there acts once per ticker
+per packet, on the state the whole packet left behind, rather than once per
+update on states that the rest of the packet is about to change.
+*/
+class PacketBot : public Bot::AbstractBot {
+public:
+  PacketBot(trader_id_t trader_id) : Bot::AbstractBot(trader_id) {
+    packet.reserve(1024);
+    touched.reserve(MAX_NUM_TICKERS);
+  }
+
+  // the updates of one packet, in the order the exchange sent them
+  virtual void on_packet(const Update* updates, size_t n, Bot::Communicator& com) = 0;
+
+  // with conflate on: `ticker`'s book changed in the packet just handled
+  virtual void on_book_changed(ticker_t ticker, Bot::Communicator& com) {}
+
+  // after on_packet() and every on_book_changed() of the packet
+  virtual void on_packet_done(Bot::Communicator& com) {}
+
+  bool conflate = false;
+
+  void on_trade_update(Common::TradeUpdate& update, Bot::Communicator& com) final {
+    append(Common::TRADE).trade = update;
+    touch(update.ticker);
+  }
+
+  void on_order_update(Common::OrderUpdate& update, Bot::Communicator& com) final {
+    append(Common::ORDER).order = update;
+    touch(update.ticker);
+  }
+
+  void on_cancel_update(Common::CancelUpdate& update, Bot::Communicator& com) final {
+    append(Common::CANCEL).cancel = update;
+    touch(update.ticker);
+  }
+
+  void on_reject_order_update(Common::RejectOrderUpdate& update, Bot::Communicator& com) final {
+    append(Common::REJECT_ORDER).reject_order = update;
+  }
+
+  void on_reject_cancel_update(Common::RejectCancelUpdate& update, Bot::Communicator& com) final {
+    append(Common::REJECT_CANCEL).reject_cancel = update;
+  }
+
+  void on_packet_start(Bot::Communicator& com) final {
+    packet_start_ns = now_ns();
+    packet_time_ns = clock ? clock() : packet_start_ns;
+    packet.clear();
+  }
+
+  // the strategy's notion of time, read once per packet into packet_time_ns;
+  // NULL for the steady clock. A replay sets it to the recorded packet times.
+  int64_t (*clock)() = NULL;
+
+  void on_packet_end(Bot::Communicator& com) final {
+    on_packet(packet.data(), packet.size(), com);
+
+    for (ticker_t ticker : touched) {
+      dirty[ticker] = false;
+      on_book_changed(ticker, com);
+    }
+    touched.clear();
+    on_packet_done(com);
+  }
+
+protected:
+  int64_t packet_start_ns = 0; // when the current packet started arriving
+  int64_t packet_time_ns = 0;  // the same, by `clock`; what strategy timing should use
+
+private:
+  Update& append(Common::UpdateType type) {
+    packet.emplace_back();
+    packet.back().type = type;
+    return packet.back();
+  }
+
+  void touch(ticker_t ticker) {
+    if (conflate && !dirty[ticker]) {
+      dirty[ticker] = true;
+      touched.push_back(ticker);
+    }
+  }
+
+  std::vector<Update> packet;
+  std::vector<ticker_t> touched; // tickers dirty in this packet, first touch first
+  bool dirty[MAX_NUM_TICKERS] = {};
+};
+
+
+/*
+A Communicator for driving a bot without the exchange, e.g. a replay or a
+benchmark. Its constructor (kirin.o) only stores the references it is given, so
+they may point at nothing as long as the bot never sends through it, which holds
+for an OrderGateway in SIM mode.
+*/
+inline Bot::Communicator offline_communicator(Bot::AbstractBot& bot) {
+  static char nothing[256];
+  return Bot::Communicator(bot,
+                           *reinterpret_cast<Router::SenderClient*>(nothing),
+                           *reinterpret_cast<Router::ReceiverClient*>(nothing));
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+
+/*
+Hardware counters for the calling thread through perf_event_open: cache misses
+(last level, as the kernel defines PERF_COUNT_HW_CACHE_MISSES) and instructions,
+read together as one group.
+
+Counting needs a PMU the kernel exposes and perf_event_paranoid <= 2 (or
+CAP_PERFMON); in VMs and containers it is often missing, in which case
+available() is false and every reading is zero.
+*/
+class PerfCounters {
+public:
+  struct Reading {
+    uint64_t cache_misses;
+    uint64_t instructions;
+  };
+
+  PerfCounters() : leader(-1), follower(-1) {
+    leader = open(PERF_COUNT_HW_CACHE_MISSES, -1);
+    if (leader >= 0) {
+      follower = open(PERF_COUNT_HW_INSTRUCTIONS, leader);
+    }
+    if (follower < 0) {
+      close_all();
+    }
+  }
+
+  ~PerfCounters() {
+    close_all();
+  }
+
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+
+  bool available() const {
+    return leader >= 0;
+  }
+
+  void start() {
+    if (available()) {
+      ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+      ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+  }
+
+  // counts since start()
+  Reading stop() {
+    Reading r{0, 0};
+    if (!available()) {
+      return r;
+    }
+    ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+    uint64_t values[3]; // nr, then one value per counter in group order
+    if (read(leader, values, sizeof(values)) == (ssize_t)sizeof(values)) {
+      r.cache_misses = values[1];
+      r.instructions = values[2];
+    }
+    return r;
+  }
+
+private:
+  static int open(uint64_t config, int group) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = group < 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+  }
+
+  void close_all() {
+    if (follower >= 0) {
+      ::close(follower);
+    }
+    if (leader >= 0) {
+      ::close(leader);
+    }
+    leader = follower = -1;
+  }
+
+  int leader;
+  int follower;
+};
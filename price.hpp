@@ -0,0 +1,77 @@
+#pragma once
+
+#include "kirin.hpp"
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+
+
+typedef int64_t tick_t;
+
+/*
+Fixed-point price: an integer number of ticks, with the tick size fixed at compile
+time. Prices coming off the wire (Common updates) are converted once with
+from_price, orders going back out are converted with to_price; books, levels,
+comparisons and spreads in between are plain integer arithmetic, so two updates
+at the same price always land on the same level.
+
+Common::Order and the update structs keep price_t: their layout is the wire
+format of the prebuilt kirin.o, so they are the edge where conversion happens.
+*/
+template <tick_t TICKS_PER_UNIT>
+struct FixedPrice {
+  tick_t ticks;
+
+  static constexpr tick_t ticks_per_unit = TICKS_PER_UNIT;
+
+  static constexpr FixedPrice from_ticks(tick_t ticks) {
+    return FixedPrice{ticks};
+  }
+
+  // rounds half away from zero, like Common::round_price
+  static FixedPrice from_price(price_t price) {
+    return FixedPrice{llround(price * TICKS_PER_UNIT)};
+  }
+
+  price_t to_price() const {
+    return ticks / (price_t)TICKS_PER_UNIT;
+  }
+
+  bool empty() const {
+    return ticks == 0;
+  }
+
+  constexpr bool operator ==(FixedPrice other) const { return ticks == other.ticks; }
+  constexpr bool operator !=(FixedPrice other) const { return ticks != other.ticks; }
+  constexpr bool operator <(FixedPrice other) const { return ticks < other.ticks; }
+  constexpr bool operator >(FixedPrice other) const { return ticks > other.ticks; }
+  constexpr bool operator <=(FixedPrice other) const { return ticks <= other.ticks; }
+  constexpr bool operator >=(FixedPrice other) const { return ticks >= other.ticks; }
+
+  constexpr FixedPrice operator +(FixedPrice other) const { return FixedPrice{ticks + other.ticks}; }
+  constexpr FixedPrice operator -(FixedPrice other) const { return FixedPrice{ticks - other.ticks}; }
+
+  // scales a price distance (e.g. a spread), rounding to the nearest tick
+  FixedPrice operator *(double factor) const {
+    return FixedPrice{llround(ticks * factor)};
+  }
+};
+
+typedef FixedPrice<100> px_t; // the exchange tick is 0.01
+
+const px_t NO_PRICE = px_t::from_ticks(0);
+
+template <tick_t T>
+std::ostream& operator <<(std::ostream& os, FixedPrice<T> price) {
+  return os << price.to_price();
+}
+
+namespace std {
+  template <tick_t T>
+  struct hash<FixedPrice<T>> {
+    size_t operator()(FixedPrice<T> price) const {
+      return std::hash<tick_t>()(price.ticks);
+    }
+  };
+};
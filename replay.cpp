@@ -0,0 +1,106 @@
+#define COMPETITOR_NO_MAIN
+#include "competitor.cpp"
+#include "capture.hpp"
+#include "latency.hpp"
+
+#include <thread>
+
+/*
+Feeds a capture (./mybot capture) back into MyBot without the exchange or any
+IPC, through the same AbstractBot callbacks the Communicator calls, packet by
+packet. By default it runs as fast as the bot can take it and reports the
+throughput; `paced` keeps the recorded gaps between packets instead.
+
+The bot's gateway runs in SIM mode, so its orders get local ids and go nowhere:
+the replayed market does not react to them. Each packet starts with the replies
+the exchange would have sent to them (MyBot::sim_replies), so they rest and get
+cancelled as they would live. The bot's clock is the recorded
+packet time, so its time-based decisions do not depend on replay speed either,
+and two runs over the same capture do exactly the same work.
+
+usage: ./replay <capture.bin> [paced]
+*/
+
+
+// the recorded start of the packet being replayed, the bot's clock
+static int64_t replay_now = 0;
+
+static void deliver(MyBot& bot, Bot::Communicator& com, Update u) {
+  switch (u.type) {
+    case Common::TRADE: bot.on_trade_update(u.trade, com); break;
+    case Common::ORDER: bot.on_order_update(u.order, com); break;
+    case Common::CANCEL: bot.on_cancel_update(u.cancel, com); break;
+    case Common::REJECT_ORDER: bot.on_reject_order_update(u.reject_order, com); break;
+    case Common::REJECT_CANCEL: bot.on_reject_cancel_update(u.reject_cancel, com); break;
+  }
+}
+
+int main(int argc, const char ** argv) {
+  if (argc < 2) {
+    std::cerr << "usage: " << argv[0] << " <capture.bin> [paced]" << std::endl;
+    return 1;
+  }
+  bool paced = argc > 2 && std::string(argv[2]) == "paced";
+
+  CaptureReader capture;
+  if (!capture.open(argv[1])) {
+    return 1;
+  }
+  std::cout << "capture: " << capture.size() << " updates";
+  if (capture.dropped()) {
+    std::cout << " (" << capture.dropped() << " dropped while recording)";
+  }
+  std::cout << std::endl;
+
+  MyBot bot(Manager::Manager::get_random_trader_id());
+  bot.order_mode = OrderGateway::SIM;
+  bot.clock = [] { return replay_now; };
+  bot.stats_interval_ns = 0;
+
+  Bot::Communicator com = offline_communicator(bot);
+  bot.init(com);
+
+  LatencyHistogram packet_latency("replay packet");
+  const CaptureRecord* r = capture.begin();
+  const int64_t start = now_ns();
+  const int64_t first_packet_ns = r != capture.end() ? r->packet_ns : 0;
+  uint64_t packets = 0;
+  std::vector<Update> replies;
+
+  while (r != capture.end()) {
+    if (paced) {
+      int64_t due = start + (r->packet_ns - first_packet_ns);
+      int64_t wait = due - now_ns();
+      if (wait > 100000) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(wait - 50000));
+      }
+      while (now_ns() < due) {
+      }
+    }
+
+    const uint64_t seq = r->packet_seq;
+    const int64_t t0 = now_ns();
+    replay_now = r->packet_ns;
+
+    replies.clear();
+    bot.sim_replies(replies);
+    bot.on_packet_start(com);
+    for (const Update& u : replies) {
+      deliver(bot, com, u);
+    }
+    for (; r != capture.end() && r->packet_seq == seq; r++) {
+      deliver(bot, com, Wire::decode(r->update));
+    }
+    bot.on_packet_end(com);
+
+    packet_latency.record(now_ns() - t0);
+    packets++;
+  }
+
+  const double seconds = (now_ns() - start) / 1e9;
+  std::cout << "replayed " << capture.size() << " updates in " << packets << " packets, "
+            << seconds << " s, " << (uint64_t)(capture.size() / seconds) << " updates/s" << std::endl;
+  dump_latencies(std::cout);
+
+  return 0;
+}
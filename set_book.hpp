@@ -0,0 +1,300 @@
+#pragma once
+
+#include "kirin.hpp"
+#include <cassert>
+#include <iostream>
+#include <fstream>
+
+#include <chrono>
+#include <cmath>
+#include <iterator>
+#include <set>
+#include <unordered_map>
+
+/*
+The original std::set based book. Every resting order is a tree node ordered by
+aggressiveness, so each insert/cancel allocates or frees a node. Kept around as
+the reference implementation that bench_book.cpp compares LevelBook against.
+*/
+struct LimitOrder {
+  price_t price;
+  mutable quantity_t quantity; // mutable so set doesn't complain
+  order_id_t order_id;
+  long long time;
+  trader_id_t trader_id;
+  bool buy;
+
+  bool operator <(const LimitOrder& other) const {
+    // < means more aggressive
+    if (buy) {
+      return price > other.price || (price == other.price && time < other.time);
+    } else {
+      return price < other.price || (price == other.price && time < other.time);
+    }
+  }
+
+  bool trades_with(const LimitOrder& other) const {
+    return ((buy && !other.buy && price >= other.price) ||
+            (!buy && other.buy && price <= other.price));
+  }
+};
+
+
+struct SetBook {
+public:
+
+  SetBook() {}
+
+  price_t get_bbo(bool buy) const {
+    const std::set<LimitOrder>& side = sides[buy];
+
+    if (side.empty()) {
+      return 0.0;
+    }
+    return side.begin()->price;
+  }
+
+  price_t get_2nd_bbo(bool buy) const {
+    const std::set<LimitOrder>&  side = sides[buy];
+
+    if (side.empty()) {
+      return 0.0;
+    }
+
+    std::set<LimitOrder>::iterator s = sides[buy].begin();
+    s++;
+    return (s->price);
+  }
+
+  /* ---USE THIS FUNCTION TO GENERATE A SIGNAL---
+  Currently, I calculate bid and ask volume for 8 levels.
+  I then calculate (bid_vol - ask_vol)/(bid_vol + ask_vol). 
+  I also weight volumes by the number of levels away they are from the touch point.
+  */
+  double get_signal(int num_levels) const {
+    bool bid = true, ask = false;
+    price_t best_bid = get_bbo(bid);
+    price_t best_offer = get_bbo(ask);
+
+    double signal = 0.0;
+
+    if (best_bid == 0.0 || best_offer == 0.0) {
+      return signal; // no signal can be found in this case
+    }
+
+    double weight;
+    // Calculate bid volume for up to n levels
+    quantity_t bid_volume = 0;
+    std::set<LimitOrder>::iterator bid_level=sides[1].begin();
+    for (int i = 0; i<num_levels && bid_level!=sides[1].end(); i++) {
+      if (bid_level -> quantity > 10000) {
+        bid_level++;
+        continue;
+      }
+      weight = 1 - abs(best_bid - bid_level->price)/best_bid;
+      bid_volume += weight * (bid_level->quantity);
+      bid_level++;
+    }
+
+    // Calculate ask volume for up to n levels
+    quantity_t ask_volume = 0;
+    std::set<LimitOrder>::iterator ask_level=sides[0].begin();
+    for (int i = 0; i<num_levels && ask_level!=sides[0].end(); i++) {
+      if (ask_level -> quantity > 10000) {
+        ask_level++;
+        continue;
+      }
+      weight = 1 - abs(ask_level->price - best_offer)/best_offer;
+      ask_volume += weight * (ask_level->quantity);
+      ask_level++;
+    }
+
+    // Calculate signal
+    signal = ((double)bid_volume - (double)ask_volume)/((double)bid_volume + (double)ask_volume);
+
+    return signal;
+  }
+
+  price_t get_mid_price(price_t default_to) const {
+    price_t best_bid = get_bbo(true);
+    price_t best_offer = get_bbo(false);
+
+    if (best_bid == 0.0 || best_offer == 0.0) {
+      return default_to;
+    }
+
+    return 0.5 * (best_bid + best_offer);
+
+  }
+
+
+  void insert(Common::Order order_to_insert) {
+
+    LimitOrder order_left = {
+      .price = order_to_insert.price,
+      .quantity = order_to_insert.quantity,
+      .order_id = order_to_insert.order_id,
+      .time = std::chrono::steady_clock::now().time_since_epoch().count(),
+      .trader_id = order_to_insert.trader_id,
+      .buy = order_to_insert.buy
+    };
+
+    auto& side = sides[(size_t)order_left.buy];
+
+    auto it_new = side.insert(order_left);
+    assert(it_new.second);
+    order_map[order_left.order_id] = it_new.first;
+
+  }
+
+  void cancel(trader_id_t trader_id, order_id_t order_id) {
+
+
+    if (!order_map.count(order_id)) {
+      std::cout << "order " << order_id << " nonexistent" << std::endl;
+      return;
+    }
+    auto it = order_map[order_id];
+
+    order_map.erase(order_id);
+
+    auto& side = sides[(size_t)it->buy];
+    side.erase(it);
+  }
+
+  quantity_t decrease_qty(order_id_t order_id, quantity_t decrease_by) {
+
+    if (!order_map.count(order_id)) {
+      return -1;
+    }
+
+    std::set<LimitOrder>::iterator it = order_map[order_id];
+
+    if (decrease_by >= it->quantity) {
+      order_map.erase(order_id);
+      std::set<LimitOrder>& side = sides[(size_t)it->buy];
+      side.erase(it);
+      return 0;
+
+    } else {
+
+      it->quantity -= decrease_by;
+      return it->quantity;
+    }
+
+  }
+
+  void print_book(std::string fp, const std::unordered_map<order_id_t, Common::Order>& mine={}) {
+    if (fp == "") {
+      return;
+    }
+
+    std::ofstream fout(fp, std::fstream::app);
+
+    fout << "offers\n";
+    for (auto rit = sides[0].rbegin(); rit != sides[0].rend(); rit++) {
+      auto x = *rit;
+      fout << x.price << ' ' << x.quantity;
+      if (mine.count(x.order_id)) {
+        fout << " (mine)";
+      }
+      fout << '\n';
+    }
+
+    fout << "\nbids\n";
+
+    for (auto& x : sides[1]) {
+      fout << x.price << ' ' << x.quantity;
+      if (mine.count(x.order_id)) {
+        fout << " (mine)";
+      }
+      fout << '\n';
+    }
+
+    fout << "EOF" << std::endl;
+
+
+    fout.close();
+  }
+
+  quantity_t quote_size(bool buy) {
+    price_t p = get_bbo(buy);
+    if (p == 0.0) {
+      return 0;
+    }
+
+    quantity_t ans = 0;
+    for (auto& x : sides[buy]) {
+      if (x.price != p) {
+        break;
+      }
+      ans += x.quantity;
+    }
+    return ans;
+  }
+  // the linear scans competitor_mine.cpp and competitor_slow.cpp used
+  quantity_t get_quote_vol(bool buy) const {
+    quantity_t vol = 0;
+    for (auto& x : sides[buy]) {
+      vol += x.quantity;
+    }
+    return vol;
+  }
+
+  int num_levels(bool buy) const {
+    int count = 0;
+    for (auto it = sides[buy].begin(); it != sides[buy].end(); it++) {
+      if (it == sides[buy].begin() || it->price != std::prev(it)->price) {
+        count++;
+      }
+    }
+    return count;
+  }
+
+  // resting quantity in the first `levels` distinct prices from the touch
+  quantity_t depth(bool buy, int levels) const {
+    quantity_t ans = 0;
+    int rank = -1;
+    for (auto it = sides[buy].begin(); it != sides[buy].end(); it++) {
+      if (it == sides[buy].begin() || it->price != std::prev(it)->price) {
+        if (++rank == levels) {
+          break;
+        }
+      }
+      ans += it->quantity;
+    }
+    return ans;
+  }
+
+  // the same levels, each order weighted by 1 - rank/levels, rank counted in
+  // distinct prices from the touch
+  double weighted_depth(bool buy, int levels) const {
+    int64_t sum = 0;
+    int rank = -1;
+    for (auto it = sides[buy].begin(); it != sides[buy].end(); it++) {
+      if (it == sides[buy].begin() || it->price != std::prev(it)->price) {
+        if (++rank == levels) {
+          break;
+        }
+      }
+      sum += it->quantity * (levels - rank);
+    }
+    return sum / (double)levels;
+  }
+
+  price_t spread() {
+
+    price_t best_bid = get_bbo(true);
+    price_t best_offer = get_bbo(false);
+
+    if (best_bid == 0.0 || best_offer == 0.0) {
+      return 0.0;
+    }
+
+    return best_offer - best_bid;
+  }
+
+private:
+  std::set<LimitOrder> sides[2];
+  std::unordered_map<order_id_t, std::set<LimitOrder>::iterator> order_map;
+};
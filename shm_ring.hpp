@@ -0,0 +1,166 @@
+#pragma once
+
+#include "spsc_ring.hpp"
+#include <cstdio>
+#include <cstring>
+
+#include <atomic>
+#include <new>
+#include <string>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/*
+An SpscRing in a POSIX shared memory segment, so the producer and the consumer
+can live in different processes.
+
+The creator sizes the segment, constructs the ring in it and then publishes a
+header (magic, element size, capacity); open() refuses a segment whose header
+does not match the type it was instantiated with, and fails until the creator
+has published. Only the creator unlinks the name, when it is destroyed.
+
+Nothing in the segment may point into either process, so T must be trivially
+copyable, and the ring indices must be lock-free atomics (those are address-free
+and work across processes; anything that falls back to a lock does not).
+
+Unlike a boost::interprocess::message_queue there is no mutex or condition
+variable: the consumer polls, and how it waits is up to the SpinWait it uses.
+*/
+template <typename T, size_t N>
+class ShmRing {
+  static_assert(std::is_trivially_copyable<T>::value, "ShmRing elements are copied between processes");
+  static_assert(std::atomic<size_t>::is_always_lock_free, "ShmRing needs lock-free atomics");
+
+public:
+  ShmRing() : segment(NULL), owner(false) {}
+
+  ~ShmRing() {
+    close();
+  }
+
+  ShmRing(const ShmRing&) = delete;
+  ShmRing& operator=(const ShmRing&) = delete;
+
+  // creates (or replaces) the segment `name`, e.g. "/bot_orders"
+  bool create(const std::string& shm_name) {
+    close();
+    shm_unlink(shm_name.c_str());
+
+    int fd = shm_open(shm_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+      perror(("shm_open " + shm_name).c_str());
+      return false;
+    }
+    if (ftruncate(fd, sizeof(Segment)) != 0) {
+      perror(("ftruncate " + shm_name).c_str());
+      ::close(fd);
+      shm_unlink(shm_name.c_str());
+      return false;
+    }
+    if (!map(fd, shm_name)) {
+      shm_unlink(shm_name.c_str());
+      return false;
+    }
+
+    new (&segment->ring) SpscRing<T, N>();
+    segment->elem_size = sizeof(T);
+    segment->capacity = N;
+    segment->magic.store(MAGIC, std::memory_order_release);
+
+    name = shm_name;
+    owner = true;
+    return true;
+  }
+
+  // attaches to a segment made by create(); false if it is missing, not yet
+  // published or made for a different T or N
+  bool open(const std::string& shm_name) {
+    close();
+
+    int fd = shm_open(shm_name.c_str(), O_RDWR, 0600);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Segment)) {
+      ::close(fd);
+      return false;
+    }
+    if (!map(fd, shm_name)) {
+      return false;
+    }
+
+    if (segment->magic.load(std::memory_order_acquire) != MAGIC ||
+        segment->elem_size != sizeof(T) || segment->capacity != N) {
+      close();
+      return false;
+    }
+
+    name = shm_name;
+    return true;
+  }
+
+  void close() {
+    if (segment) {
+      munmap(segment, sizeof(Segment));
+      segment = NULL;
+    }
+    if (owner) {
+      shm_unlink(name.c_str());
+      owner = false;
+    }
+  }
+
+  bool is_open() const {
+    return segment != NULL;
+  }
+
+  SpscRing<T, N>& ring() {
+    return segment->ring;
+  }
+
+  // blocking helpers for either end; the SpinWait decides how they wait
+  void push(const T& x, SpinWait& waiter) {
+    while (!segment->ring.try_push(x)) {
+      waiter.wait();
+    }
+    waiter.reset();
+  }
+
+  void pop(T& x, SpinWait& waiter) {
+    while (!segment->ring.try_pop(x)) {
+      waiter.wait();
+    }
+    waiter.reset();
+  }
+
+private:
+  static const uint64_t MAGIC = 0x53505343524e4731ULL; // "SPSCRNG1"
+
+  struct Segment {
+    std::atomic<uint64_t> magic; // written last by the creator
+    uint32_t elem_size;
+    uint32_t capacity;
+    SpscRing<T, N> ring;
+  };
+
+  bool map(int fd, const std::string& shm_name) {
+    void* p = mmap(NULL, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+      perror(("mmap " + shm_name).c_str());
+      return false;
+    }
+    segment = static_cast<Segment*>(p);
+    return true;
+  }
+
+  Segment* segment;
+  bool owner;
+  std::string name;
+};
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "kirin.hpp"
+#include "level_book.hpp"
+#include "price.hpp"
+#include <cmath>
+
+#include <algorithm>
+#include <vector>
+
+
+struct ImbalanceConfig {
+  enum Decay {
+    FLAT,        // every level in the window counts fully
+    LINEAR,      // weight 1 - distance/depth
+    EXPONENTIAL  // weight exp(-rate * distance)
+  };
+
+  int depth;            // window size in ticks from the touch, touch included
+  Decay decay;
+  double rate;          // only used by EXPONENTIAL
+  quantity_t level_cap; // a level counts for at most this much, NO_QTY_LIMIT for none
+};
+
+
+/*
+Order-book imbalance (bid_depth - ask_depth)/(bid_depth + ask_depth) for any
+number of configured variants, maintained from the book's level deltas instead
+of being recomputed on every query.
+
+Each variant keeps a weighted, capped depth sum per side. A level change inside
+the window moves that sum by weight * (capped new qty - capped old qty); only a
+move of the touch rescans the window of that side, which also discards any
+rounding drift from the incremental updates. Reading a variant is O(1).
+
+Attach one engine per book with LevelBook::set_listener.
+*/
+struct SignalEngine : public LevelListener {
+public:
+
+  // returns the index to pass to imbalance()
+  int add(const ImbalanceConfig& config) {
+    Variant v;
+    v.config = config;
+    v.sum[0] = v.sum[1] = 0.0;
+
+    for (int d = 0; d < config.depth; d++) {
+      switch (config.decay) {
+        case ImbalanceConfig::FLAT: v.weights.push_back(1.0); break;
+        case ImbalanceConfig::LINEAR: v.weights.push_back(1.0 - (double)d / config.depth); break;
+        case ImbalanceConfig::EXPONENTIAL: v.weights.push_back(exp(-config.rate * d)); break;
+      }
+    }
+
+    variants.push_back(v);
+    return variants.size() - 1;
+  }
+
+  size_t size() const {
+    return variants.size();
+  }
+
+  // in [-1, 1], positive when bids outweigh offers; 0 when either side is empty
+  double imbalance(int variant) const {
+    const Variant& v = variants[variant];
+    if (v.sum[1] <= 0.0 || v.sum[0] <= 0.0) {
+      return 0.0;
+    }
+    return (v.sum[1] - v.sum[0]) / (v.sum[1] + v.sum[0]);
+  }
+
+  // recomputes every variant from the book, e.g. after attaching to a non-empty book
+  void refresh(const LevelBook& book) {
+    rescan(book, true);
+    rescan(book, false);
+  }
+
+  void on_level_change(const LevelBook& book, bool buy, tick_t tick, quantity_t delta) override {
+    const tick_t best = book.get_bbo(buy).ticks;
+    const tick_t distance = buy ? best - tick : tick - best;
+    const quantity_t new_qty = book.level_qty(buy, tick);
+    const quantity_t old_qty = new_qty - delta;
+
+    for (Variant& v : variants) {
+      if (distance < v.config.depth) {
+        quantity_t cap = v.config.level_cap;
+        v.sum[buy] += v.weights[distance] * (std::min(new_qty, cap) - std::min(old_qty, cap));
+      }
+    }
+  }
+
+  void on_touch_change(const LevelBook& book, bool buy) override {
+    rescan(book, buy);
+  }
+
+private:
+  struct Variant {
+    ImbalanceConfig config;
+    std::vector<double> weights; // by distance from the touch
+    double sum[2];
+  };
+
+  void rescan(const LevelBook& book, bool buy) {
+    const px_t best = book.get_bbo(buy);
+    const tick_t step = buy ? -1 : 1;
+
+    for (Variant& v : variants) {
+      v.sum[buy] = 0.0;
+      if (best.empty()) {
+        continue;
+      }
+      for (int d = 0; d < v.config.depth; d++) {
+        quantity_t qty = book.level_qty(buy, best.ticks + step * d);
+        v.sum[buy] += v.weights[d] * std::min(qty, v.config.level_cap);
+      }
+    }
+  }
+
+  std::vector<Variant> variants;
+};
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+
+
+/*
+What a polling loop does each time it finds nothing to do.
+
+Spins (with a pause hint) for spin_limit rounds, then yields the CPU on every
+further round until reset() is called after some work was found. BUSY_POLL never
+yields, which only makes sense when the poller owns a core; on a shared core a
+spinning consumer can starve the very producer it is waiting for, so the default
+limit does not spin at all on a single-core machine.
+*/
+class SpinWait {
+public:
+  static const int BUSY_POLL = -1;
+  static const int ADAPTIVE = 1000;
+
+  static int default_limit() {
+    static const int limit = std::thread::hardware_concurrency() > 1 ? ADAPTIVE : 0;
+    return limit;
+  }
+
+  explicit SpinWait(int spin_limit = default_limit()) : limit(spin_limit), spins(0) {}
+
+  void wait() {
+    if (limit < 0 || spins < limit) {
+      spins++;
+#if defined(__x86_64__) || defined(__i386__)
+      __builtin_ia32_pause();
+#endif
+      return;
+    }
+    std::this_thread::yield();
+  }
+
+  void reset() {
+    spins = 0;
+  }
+
+private:
+  int limit;
+  int spins;
+};
+
+
+/*
+Bounded lock-free queue for exactly one producer thread and one consumer thread.
+
+head_ is only written by the producer and tail_ only by the consumer, each on its
+own cache line. Both sides keep a private copy of the other's index and only
+reload it when the ring looks full (producer) or empty (consumer), so in steady
+state a push or pop touches no shared line but the slot itself.
+*/
+template <typename T, size_t N>
+class SpscRing {
+  static_assert(N && (N & (N - 1)) == 0, "SpscRing capacity must be a power of two");
+
+public:
+  SpscRing() : head_(0), tail_cache_(0), tail_(0), head_cache_(0) {}
+
+  SpscRing(const SpscRing&) = delete;
+  SpscRing& operator=(const SpscRing&) = delete;
+
+  // producer side; false when the ring is full
+  bool try_push(const T& x) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_cache_ == N) {
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+      if (head - tail_cache_ == N) {
+        return false;
+      }
+    }
+    buf_[head & (N - 1)] = x;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // producer side; publishes all n items with a single release store, or none of
+  // them when there is not room for all
+  bool try_push_n(const T* xs, size_t n) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (N - (head - tail_cache_) < n) {
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+      if (N - (head - tail_cache_) < n) {
+        return false;
+      }
+    }
+    for (size_t i = 0; i < n; i++) {
+      buf_[(head + i) & (N - 1)] = xs[i];
+    }
+    head_.store(head + n, std::memory_order_release);
+    return true;
+  }
+
+  // consumer side; false when the ring is empty
+  bool try_pop(T& x) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == head_cache_) {
+      head_cache_ = head_.load(std::memory_order_acquire);
+      if (tail == head_cache_) {
+        return false;
+      }
+    }
+    x = buf_[tail & (N - 1)];
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // only a hint when called from a third thread
+  bool empty() const {
+    return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+  }
+
+  static constexpr size_t capacity() {
+    return N;
+  }
+
+private:
+  alignas(64) std::atomic<size_t> head_;
+  size_t tail_cache_; // producer's view of tail_
+
+  alignas(64) std::atomic<size_t> tail_;
+  size_t head_cache_; // consumer's view of head_
+
+  alignas(64) T buf_[N];
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "spsc_ring.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include <thread>
+
+
+/*
+How a latency-critical thread runs: which CPU it is pinned to, whether it is
+scheduled SCHED_FIFO, and how its polling loops wait when idle (a SpinWait
+limit; SpinWait::BUSY_POLL never gives the CPU up).
+
+apply() is called by the thread itself. Pinning a spinning thread only pays when
+the CPU is its own; on a machine with fewer CPUs than busy threads a busy-polling
+SCHED_FIFO thread can lock everything else out, so the defaults change nothing.
+SCHED_FIFO needs CAP_SYS_NICE (or a large enough RLIMIT_RTPRIO); failures are
+reported and the thread carries on as it was.
+
+SCHED_FIFO is refused outright on a single-CPU machine. A FIFO thread that
+yields only makes way for other FIFO threads, and the waits inside kirin.o's
+message queue yield, so the exchange and the other bots would barely run
+(measured: 1 trade in 10 s instead of about 150).
+*/
+struct ThreadPolicy {
+  int cpu = -1;           // CPU to pin to, -1 to leave the affinity alone
+  int fifo_priority = 0;  // SCHED_FIFO priority (1-99), 0 for the normal scheduler
+  int spin_limit = SpinWait::default_limit();
+
+  // applies cpu and fifo_priority to the calling thread; false if any part failed
+  bool apply(const char* name) const {
+    bool ok = true;
+
+    if (cpu >= 0) {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(cpu, &set);
+      int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+      if (err) {
+        fprintf(stderr, "%s: pinning to cpu %d: %s\n", name, cpu, strerror(err));
+        ok = false;
+      }
+    }
+
+    if (fifo_priority > 0 && std::thread::hardware_concurrency() <= 1) {
+      fprintf(stderr, "%s: not using SCHED_FIFO on a single CPU\n", name);
+      ok = false;
+    } else if (fifo_priority > 0) {
+      sched_param param;
+      param.sched_priority = fifo_priority;
+      int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+      if (err) {
+        fprintf(stderr, "%s: SCHED_FIFO %d: %s\n", name, fifo_priority, strerror(err));
+        ok = false;
+      }
+    }
+
+    return ok;
+  }
+};
+
+
+// keeps every page of the process resident from now on, so the hot path never
+// takes a page fault; needs CAP_IPC_LOCK or a large enough RLIMIT_MEMLOCK
+inline bool lock_memory() {
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    fprintf(stderr, "mlockall: %s\n", strerror(errno));
+    return false;
+  }
+  return true;
+}
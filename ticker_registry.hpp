@@ -0,0 +1,72 @@
+#pragma once
+
+#include "kirin.hpp"
+
+#include <memory>
+#include <vector>
+
+
+/*
+Per-ticker state of type T, created the first time a ticker is asked for instead
+of for all MAX_NUM_TICKERS up front.
+
+Lookup is one byte-indexed array read. The states that do exist are also
+numbered densely in creation order, so code that has to visit every ticker
+(PnL, snapshots) iterates only over those. Each state is allocated on its own
+and never moves, so it may hold pointers into itself (a book's listener) and
+references to it stay valid as more tickers appear.
+*/
+template <typename T>
+class TickerRegistry {
+public:
+  TickerRegistry() {
+    for (int i = 0; i < MAX_NUM_TICKERS; i++) {
+      slot[i] = -1;
+    }
+  }
+
+  // the state for `ticker`, created (as T(ticker)) if this is the first time
+  T& get(ticker_t ticker) {
+    int16_t i = slot[ticker];
+    if (i < 0) {
+      i = states.size();
+      slot[ticker] = i;
+      states.emplace_back(new T(ticker));
+      tickers.push_back(ticker);
+    }
+    return *states[i];
+  }
+
+  // NULL for a ticker that has not been seen
+  T* find(ticker_t ticker) {
+    int16_t i = slot[ticker];
+    return i < 0 ? NULL : states[i].get();
+  }
+
+  const T* find(ticker_t ticker) const {
+    int16_t i = slot[ticker];
+    return i < 0 ? NULL : states[i].get();
+  }
+
+  // dense iteration: 0 <= i < size(), in creation order
+  size_t size() const {
+    return states.size();
+  }
+
+  T& at(size_t i) {
+    return *states[i];
+  }
+
+  const T& at(size_t i) const {
+    return *states[i];
+  }
+
+  ticker_t ticker_at(size_t i) const {
+    return tickers[i];
+  }
+
+private:
+  int16_t slot[MAX_NUM_TICKERS]; // index into states, -1 if not seen
+  std::vector<std::unique_ptr<T>> states;
+  std::vector<ticker_t> tickers;
+};
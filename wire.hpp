@@ -0,0 +1,153 @@
+#pragma once
+
+#include "kirin.hpp"
+#include "packet_bot.hpp"
+#include <cstddef>
+#include <cstdint>
+
+#include <type_traits>
+
+
+/*
+Compact layouts of the Common messages for everything the bot stores or queues
+itself (capture files, the order gateway's ring).
+
+The Common structs are laid out in declaration order, so a 1-byte ticker in front
+of a double and bools between 8-byte fields cost 7 bytes of padding each:
+Common::Order and Common::TradeUpdate are 48 bytes. Here the 8-byte fields come
+first and the small ones share the last word, with the bools folded into flags,
+so an order is 40 bytes and any update fits one 40-byte record.
+
+They cannot replace the Common structs themselves: kirin.o is built against
+those, and they are what crosses the exchange's message queues.
+
+The layouts are fixed by the static_asserts below. Anything stored in this form
+carries WIRE_VERSION, which must change with them.
+*/
+namespace Wire {
+
+const uint32_t WIRE_VERSION = 1;
+
+enum Flags : uint8_t {
+  BUY = 1,
+  IOC = 2
+};
+
+struct Order {
+  price_t price;
+  quantity_t quantity;
+  order_id_t order_id;
+  trader_id_t trader_id;
+  ticker_t ticker;
+  uint8_t flags;
+};
+
+// any of the five update types; fields a type does not have are zero
+struct Update {
+  price_t price;                  // TRADE, ORDER
+  quantity_t quantity;            // TRADE, ORDER
+  order_id_t order_id;            // the resting order for a TRADE
+  order_id_t aggressing_order_id; // TRADE
+  uint8_t type;                   // Common::UpdateType
+  ticker_t ticker;
+  uint8_t flags;                  // BUY: TRADE (the aggressor's side), ORDER
+  uint8_t reason;                 // Common::RejectReason, REJECT_ORDER and REJECT_CANCEL
+};
+
+static_assert(sizeof(Order) == 40, "Wire::Order layout changed, bump WIRE_VERSION");
+static_assert(offsetof(Order, price) == 0 && offsetof(Order, quantity) == 8 &&
+              offsetof(Order, order_id) == 16 && offsetof(Order, trader_id) == 24 &&
+              offsetof(Order, ticker) == 32 && offsetof(Order, flags) == 33,
+              "Wire::Order layout changed, bump WIRE_VERSION");
+
+static_assert(sizeof(Update) == 40, "Wire::Update layout changed, bump WIRE_VERSION");
+static_assert(offsetof(Update, price) == 0 && offsetof(Update, quantity) == 8 &&
+              offsetof(Update, order_id) == 16 && offsetof(Update, aggressing_order_id) == 24 &&
+              offsetof(Update, type) == 32 && offsetof(Update, ticker) == 33 &&
+              offsetof(Update, flags) == 34 && offsetof(Update, reason) == 35,
+              "Wire::Update layout changed, bump WIRE_VERSION");
+
+static_assert(std::is_trivially_copyable<Order>::value && std::is_trivially_copyable<Update>::value,
+              "wire records are copied as bytes");
+
+
+inline Order encode(const Common::Order& o) {
+  return Order{o.price, o.quantity, o.order_id, o.trader_id, o.ticker,
+               (uint8_t)((o.buy ? BUY : 0) | (o.ioc ? IOC : 0))};
+}
+
+inline Common::Order decode(const Order& o) {
+  return Common::Order{
+    .ticker = o.ticker,
+    .price = o.price,
+    .quantity = o.quantity,
+    .buy = (o.flags & BUY) != 0,
+    .ioc = (o.flags & IOC) != 0,
+    .order_id = o.order_id,
+    .trader_id = o.trader_id
+  };
+}
+
+inline Update encode(const ::Update& u) {
+  Update w = Update{0.0, 0, 0, 0, (uint8_t)u.type, 0, 0, 0};
+
+  switch (u.type) {
+    case Common::TRADE:
+      w.price = u.trade.price;
+      w.quantity = u.trade.quantity;
+      w.order_id = u.trade.resting_order_id;
+      w.aggressing_order_id = u.trade.aggressing_order_id;
+      w.ticker = u.trade.ticker;
+      w.flags = u.trade.buy ? BUY : 0;
+      break;
+    case Common::ORDER:
+      w.price = u.order.price;
+      w.quantity = u.order.quantity;
+      w.order_id = u.order.order_id;
+      w.ticker = u.order.ticker;
+      w.flags = u.order.buy ? BUY : 0;
+      break;
+    case Common::CANCEL:
+      w.order_id = u.cancel.order_id;
+      w.ticker = u.cancel.ticker;
+      break;
+    case Common::REJECT_ORDER:
+      w.order_id = u.reject_order.order_id;
+      w.ticker = u.reject_order.ticker;
+      w.reason = u.reject_order.reason;
+      break;
+    case Common::REJECT_CANCEL:
+      w.order_id = u.reject_cancel.order_id;
+      w.ticker = u.reject_cancel.ticker;
+      w.reason = u.reject_cancel.reason;
+      break;
+  }
+  return w;
+}
+
+inline ::Update decode(const Update& w) {
+  ::Update u;
+  u.type = (Common::UpdateType)w.type;
+  const bool buy = (w.flags & BUY) != 0;
+
+  switch (u.type) {
+    case Common::TRADE:
+      u.trade = Common::TradeUpdate{w.ticker, w.price, w.quantity, w.order_id, w.aggressing_order_id, buy};
+      break;
+    case Common::ORDER:
+      u.order = Common::OrderUpdate{w.ticker, w.price, w.quantity, w.order_id, buy};
+      break;
+    case Common::CANCEL:
+      u.cancel = Common::CancelUpdate{w.ticker, w.order_id};
+      break;
+    case Common::REJECT_ORDER:
+      u.reject_order = Common::RejectOrderUpdate{w.ticker, w.order_id, (Common::RejectReason)w.reason};
+      break;
+    case Common::REJECT_CANCEL:
+      u.reject_cancel = Common::RejectCancelUpdate{w.ticker, w.order_id, (Common::RejectReason)w.reason};
+      break;
+  }
+  return u;
+}
+
+}